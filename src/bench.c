@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "system_bridge.h"
+#include "gpu_profiler.h"
+
+/*
+	Frame benchmark printing JSON to stdout.
+
+	zBench [--frames N] [--warmup N] [--max-count N] [--windowed]
+		Sweeps particle counts, render paths and, with --windowed, present modes.
+		Every configuration runs in a child process of its own, nothing
+		of one setup leaks into the next and a failing one is reported
+		without ending the sweep. Runs are headless by default so software
+		Vulkan implementations on machines without GPUs and displays work.
+
+	zBench --run COUNT PATH PRESENT_MODE FRAMES WARMUP
+		Runs one configuration in this process and prints one JSON object.
+*/
+
+#define DEFAULT_FRAMES 300
+#define DEFAULT_WARMUP 30
+#define OUTPUT_LINE_SIZE 4096
+
+/*
+	Recorded with every run, debug numbers include validation layers.
+*/
+#ifdef _DEBUG
+#define BUILD_NAME "debug"
+#else
+#define BUILD_NAME "release"
+#endif
+
+typedef struct NamedRenderPath
+{
+	const char *name;
+	RenderPath render_path;
+
+} NamedRenderPath;
+
+typedef struct NamedPresentMode
+{
+	const char *name;
+	VkPresentModeKHR present_mode;
+
+} NamedPresentMode;
+
+typedef struct Percentiles
+{
+	double p50;
+	double p95;
+	double p99;
+
+} Percentiles;
+
+static const uint32_t _particle_counts[] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+static const NamedRenderPath _render_paths[] = {
+	{ "compute_expanded", RENDER_PATH_COMPUTE_EXPANDED },
+	{ "vertex_pulling", RENDER_PATH_VERTEX_PULLING },
+	{ "instanced", RENDER_PATH_INSTANCED },
+};
+
+/*
+	"none" draws headless and presents nothing.
+*/
+static const NamedPresentMode _present_modes[] = {
+	{ "none", VK_PRESENT_MODE_FIFO_KHR },
+	{ "fifo", VK_PRESENT_MODE_FIFO_KHR },
+	{ "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+	{ "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR },
+};
+
+#define RENDER_PATHS_COUNT (sizeof(_render_paths) / sizeof(_render_paths[0]))
+#define PRESENT_MODES_COUNT (sizeof(_present_modes) / sizeof(_present_modes[0]))
+#define PARTICLE_COUNTS_COUNT (sizeof(_particle_counts) / sizeof(_particle_counts[0]))
+
+static int _compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+/*
+	Nearest rank percentiles of the non-negative values,
+	negative ones are unknown and skipped. False if none is left.
+*/
+static bool _get_percentiles(const double *values, uint32_t count, Percentiles *percentiles)
+{
+	double *sorted = (double *)malloc(sizeof(double) * (count > 0 ? count : 1));
+	uint32_t sorted_count = 0;
+
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		if (values[i] >= 0.0)
+		{
+			sorted[sorted_count] = values[i];
+			sorted_count += 1;
+		}
+	}
+
+	if (sorted_count > 0)
+	{
+		qsort(sorted, sorted_count, sizeof(double), _compare_doubles);
+
+		percentiles->p50 = sorted[(sorted_count * 50 + 99) / 100 - 1];
+		percentiles->p95 = sorted[(sorted_count * 95 + 99) / 100 - 1];
+		percentiles->p99 = sorted[(sorted_count * 99 + 99) / 100 - 1];
+	}
+
+	free(sorted);
+
+	return sorted_count > 0;
+}
+static void _print_percentiles(const char *name, const double *values, uint32_t count)
+{
+	Percentiles percentiles;
+
+	if (_get_percentiles(values, count, &percentiles))
+	{
+		printf(
+			", \"%s\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }",
+			name, percentiles.p50, percentiles.p95, percentiles.p99
+		);
+	}
+	else
+	{
+		printf(", \"%s\": null", name);
+	}
+}
+/*
+	Average and max of every pass the GPU profiler timed, an empty object
+	when the device cannot write timestamps.
+*/
+static void _print_gpu_passes()
+{
+	const GpuProfilerStats *stats = get_gpu_profiler_stats();
+
+	printf(", \"gpu_passes\": {");
+
+	for (uint32_t i = 0; i < stats->pass_count; i += 1)
+	{
+		printf(
+			"%s \"%s\": { \"average\": %.4f, \"max\": %.4f }",
+			i == 0 ? "" : ",",
+			stats->passes[i].name,
+			stats->passes[i].average_milliseconds,
+			stats->passes[i].max_milliseconds
+		);
+	}
+
+	printf(" }");
+}
+/*
+	Particles fill the cube in front of the camera in a fixed pseudo random
+	order, every run of a count draws the same scene.
+*/
+static bool _create_bench_particles(uint32_t count)
+{
+	Particles particles = {
+		.positions = (Vector4 *)malloc(sizeof(Vector4) * count),
+		.colors = (Color *)malloc(sizeof(Color) * count),
+		.count = count,
+	};
+
+	if (particles.positions == NULL || particles.colors == NULL)
+	{
+		free_particles(&particles);
+
+		return false;
+	}
+
+	uint32_t state = 0x9e3779b9u;
+
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		float random[3];
+
+		for (uint32_t j = 0; j < 3; j += 1)
+		{
+			state = state * 1664525u + 1013904223u;
+			random[j] = (float)(state >> 8) / (float)(1u << 24);
+		}
+
+		particles.positions[i].x = random[0] * 2.0f - 1.0f;
+		particles.positions[i].y = random[1] * 2.0f - 1.0f;
+		particles.positions[i].z = random[2] * 2.0f - 1.0f;
+		particles.positions[i].w = 1.0f;
+
+		particles.colors[i].red = random[0];
+		particles.colors[i].green = random[1];
+		particles.colors[i].blue = random[2];
+		particles.colors[i].alpha = 1.0f;
+	}
+
+	set_initial_particles(&particles);
+
+	return true;
+}
+static int _run(uint32_t count, const NamedRenderPath *path, const NamedPresentMode *mode, uint32_t frames, uint32_t warmup)
+{
+	RenderSettings settings = {
+		.frames_in_flight = 2,
+		.render_path = path->render_path,
+		.present_mode = mode->present_mode,
+		.blend_particles = false,
+		.particle_format = PARTICLE_FORMAT_FLOAT,
+		.particle_bounds_min = { -4.0f, -4.0f, -4.0f },
+		.particle_bounds_max = { 4.0f, 4.0f, 4.0f },
+		.physics = {
+			.gravity = { 0.0f, 0.1f, 0.0f },
+			.drag = 0.5f,
+			.time_step = 1.0f / 120.0f,
+			.max_steps_per_frame = 4,
+			.particle_capacity = count,
+			.emission_rate = 0.0f,
+			.emission_speed = 0.5f,
+			.particle_life_time = 3.0f,
+			.emitter_position = { 0.0f, 0.0f, 0.0f },
+			.emission_color = { 1.0f, 0.5f, 0.0f, 1.0f },
+			.fluid = {
+				.enabled = false,
+			},
+			.nbody = {
+				.solver = GRAVITY_SOLVER_NONE,
+				.softening = 0.01f,
+			},
+		},
+		.headless = {
+			.enabled = strcmp(mode->name, "none") == 0,
+			.width = 800,
+			.height = 600,
+			.frame_count = warmup + frames,
+		},
+	};
+
+	create_particles();
+
+	if (!_create_bench_particles(count) || !setup_window_and_gpu(&settings))
+	{
+		return EXIT_FAILURE;
+	}
+
+	FrameTimings *timings = (FrameTimings *)malloc(sizeof(FrameTimings) * frames);
+	double *values = (double *)malloc(sizeof(double) * frames);
+
+	/*
+		Pass stats of the warmup frames are dropped with the frames themselves.
+	*/
+	bool result = timings != NULL && values != NULL && render_frames(warmup, NULL);
+
+	reset_gpu_profiler_stats();
+
+	result = result && render_frames(frames, timings);
+
+	if (result)
+	{
+		const FrameTimings *measured = timings;
+		double total_milliseconds = 0.0;
+
+		printf(
+			"{ \"build\": \"%s\", \"particles\": %u, \"render_path\": \"%s\", \"present_mode\": \"%s\", \"frames\": %u",
+			BUILD_NAME, count, path->name, mode->name, frames
+		);
+
+		for (uint32_t i = 0; i < frames; i += 1)
+		{
+			values[i] = measured[i].cpu_milliseconds;
+			total_milliseconds += measured[i].cpu_milliseconds;
+		}
+
+		_print_percentiles("cpu_frame_ms", values, frames);
+
+		for (uint32_t i = 0; i < frames; i += 1)
+		{
+			values[i] = measured[i].gpu_compute_milliseconds;
+		}
+
+		_print_percentiles("gpu_compute_ms", values, frames);
+
+		for (uint32_t i = 0; i < frames; i += 1)
+		{
+			values[i] = measured[i].gpu_graphics_milliseconds;
+		}
+
+		_print_percentiles("gpu_graphics_ms", values, frames);
+		_print_gpu_passes();
+
+		printf(
+			", \"particles_per_second\": %.0f }\n",
+			total_milliseconds > 0.0 ? (double)count * frames / (total_milliseconds * 1e-3) : 0.0
+		);
+	}
+
+	free(timings);
+	free(values);
+
+	destroy_particles();
+
+	destroy_window_and_free_gpu();
+
+	return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+/*
+	Only the line of the result starts with a brace,
+	setup messages of the child are dropped.
+*/
+static void _sweep_run(const char *executable, uint32_t count, const NamedRenderPath *path, const NamedPresentMode *mode, uint32_t frames, uint32_t warmup, bool is_first)
+{
+	char command[OUTPUT_LINE_SIZE];
+	char line[OUTPUT_LINE_SIZE];
+	bool has_result = false;
+
+	snprintf(command, sizeof(command), "\"%s\" --run %u %s %s %u %u", executable, count, path->name, mode->name, frames, warmup);
+
+	printf("%s\n\t", is_first ? "" : ",");
+
+	FILE *child = popen(command, "r");
+
+	if (child != NULL)
+	{
+		while (fgets(line, sizeof(line), child) != NULL)
+		{
+			if (line[0] == '{' && !has_result)
+			{
+				line[strcspn(line, "\n")] = '\0';
+
+				printf("%s", line);
+
+				has_result = true;
+			}
+		}
+
+		has_result = pclose(child) == 0 && has_result;
+	}
+
+	if (!has_result)
+	{
+		printf(
+			"{ \"build\": \"%s\", \"particles\": %u, \"render_path\": \"%s\", \"present_mode\": \"%s\", \"error\": \"run failed\" }",
+			BUILD_NAME, count, path->name, mode->name
+		);
+	}
+
+	fflush(stdout);
+}
+static const NamedRenderPath *_find_render_path(const char *name)
+{
+	for (uint32_t i = 0; i < RENDER_PATHS_COUNT; i += 1)
+	{
+		if (strcmp(_render_paths[i].name, name) == 0)
+		{
+			return _render_paths + i;
+		}
+	}
+
+	return NULL;
+}
+static const NamedPresentMode *_find_present_mode(const char *name)
+{
+	for (uint32_t i = 0; i < PRESENT_MODES_COUNT; i += 1)
+	{
+		if (strcmp(_present_modes[i].name, name) == 0)
+		{
+			return _present_modes + i;
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	if (argc == 7 && strcmp(argv[1], "--run") == 0)
+	{
+		const NamedRenderPath *path = _find_render_path(argv[3]);
+		const NamedPresentMode *mode = _find_present_mode(argv[4]);
+
+		if (path == NULL || mode == NULL)
+		{
+			return EXIT_FAILURE;
+		}
+
+		return _run(
+			(uint32_t)strtoul(argv[2], NULL, 10),
+			path,
+			mode,
+			(uint32_t)strtoul(argv[5], NULL, 10),
+			(uint32_t)strtoul(argv[6], NULL, 10)
+		);
+	}
+
+	uint32_t frames = DEFAULT_FRAMES;
+	uint32_t warmup = DEFAULT_WARMUP;
+	uint32_t max_count = UINT32_MAX;
+	bool windowed = false;
+
+	for (int i = 1; i < argc; i += 1)
+	{
+		if (strcmp(argv[i], "--windowed") == 0)
+		{
+			windowed = true;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--frames") == 0)
+		{
+			i += 1;
+			frames = (uint32_t)strtoul(argv[i], NULL, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--warmup") == 0)
+		{
+			i += 1;
+			warmup = (uint32_t)strtoul(argv[i], NULL, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--max-count") == 0)
+		{
+			i += 1;
+			max_count = (uint32_t)strtoul(argv[i], NULL, 10);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--frames N] [--warmup N] [--max-count N] [--windowed]\n", argv[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (frames == 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	bool is_first = true;
+
+	printf("[");
+
+	for (uint32_t i = 0; i < PARTICLE_COUNTS_COUNT && _particle_counts[i] <= max_count; i += 1)
+	{
+		for (uint32_t j = 0; j < RENDER_PATHS_COUNT; j += 1)
+		{
+			/*
+				Headless runs only use "none", windowed ones every other mode.
+			*/
+			for (uint32_t k = windowed ? 1 : 0; k < (windowed ? PRESENT_MODES_COUNT : 1); k += 1)
+			{
+				_sweep_run(argv[0], _particle_counts[i], _render_paths + j, _present_modes + k, frames, warmup, is_first);
+
+				is_first = false;
+			}
+		}
+	}
+
+	printf("\n]\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache_files.h"
+
+#define CACHE_DIRECTORY_NAME "zGame"
+
+/* Helper functions */
+
+static bool _make_directory(const char *path)
+{
+	return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+/*
+	Relative XDG_CACHE_HOME is invalid by the base directory specification
+	and ignored like an unset one.
+*/
+static bool _get_cache_directory(char *path, size_t path_size)
+{
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int length;
+
+	if (xdg_cache_home != NULL && xdg_cache_home[0] == '/')
+	{
+		length = snprintf(path, path_size, "%s", xdg_cache_home);
+	}
+	else if (home != NULL && home[0] == '/')
+	{
+		length = snprintf(path, path_size, "%s/.cache", home);
+	}
+	else
+	{
+		return false;
+	}
+
+	if (length < 0 || (size_t)length >= path_size || !_make_directory(path))
+	{
+		return false;
+	}
+
+	size_t base_length = (size_t)length;
+
+	length = snprintf(path + base_length, path_size - base_length, "/%s", CACHE_DIRECTORY_NAME);
+
+	return length >= 0 && (size_t)length < path_size - base_length && _make_directory(path);
+}
+/*
+	Makes the rename itself durable, failure leaves a complete file either way.
+*/
+static void _sync_parent_directory(const char *path)
+{
+	char directory[CACHE_FILE_PATH_SIZE];
+
+	const char *separator = strrchr(path, '/');
+	size_t length = separator != NULL ? (size_t)(separator - path) : 0;
+
+	if (length == 0 || length >= sizeof(directory))
+	{
+		return;
+	}
+
+	memcpy(directory, path, length);
+	directory[length] = '\0';
+
+	int directory_descriptor = open(directory, O_RDONLY | O_DIRECTORY);
+
+	if (directory_descriptor >= 0)
+	{
+		fsync(directory_descriptor);
+		close(directory_descriptor);
+	}
+}
+
+/* Module interface */
+
+bool get_cache_file_path(const char *file_name, char *path, size_t path_size)
+{
+	if (!_get_cache_directory(path, path_size))
+	{
+		return false;
+	}
+
+	size_t directory_length = strlen(path);
+	int length = snprintf(path + directory_length, path_size - directory_length, "/%s", file_name);
+
+	return length >= 0 && (size_t)length < path_size - directory_length;
+}
+bool write_file_atomically(const char *path, const void *data, size_t size)
+{
+	char tmp_path[CACHE_FILE_PATH_SIZE];
+	int length = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	if (length < 0 || (size_t)length >= sizeof(tmp_path))
+	{
+		return false;
+	}
+
+	FILE *file_descriptor = fopen(tmp_path, "wb");
+
+	if (!file_descriptor)
+	{
+		return false;
+	}
+
+	bool result = size == 0 || fwrite(data, size, 1, file_descriptor) == 1;
+
+	result = result && fflush(file_descriptor) == 0;
+	result = result && fsync(fileno(file_descriptor)) == 0;
+	result = fclose(file_descriptor) == 0 && result;
+	result = result && rename(tmp_path, path) == 0;
+
+	if (result)
+	{
+		_sync_parent_directory(path);
+	}
+	else
+	{
+		remove(tmp_path);
+	}
+
+	return result;
+}
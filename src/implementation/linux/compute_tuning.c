@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compute_tuning.h"
+#include "cache_files.h"
+
+/*
+	"GTU2", sizes tuned on the scene of the first run under "GTUN" are dropped.
+*/
+#define COMPUTE_TUNING_CACHE_MAGIC 0x32555447
+
+typedef struct TuningRecord
+{
+	uint8_t device_uuid[VK_UUID_SIZE];
+	uint32_t driver_version;
+	uint32_t workgroup_size;
+
+} TuningRecord;
+
+typedef struct TuningRecords
+{
+	TuningRecord *data;
+	uint32_t count;
+
+} TuningRecords;
+
+/* Helper functions */
+
+/*
+	Missing or malformed file reads as an empty cache.
+*/
+static void _read_records(const char *path, TuningRecords *records)
+{
+	records->data = NULL;
+	records->count = 0;
+
+	FILE *file_descriptor = fopen(path, "rb");
+
+	if (!file_descriptor)
+	{
+		return;
+	}
+
+	uint32_t header[2];
+
+	if (
+		fread(header, sizeof(header), 1, file_descriptor) == 1 &&
+		header[0] == COMPUTE_TUNING_CACHE_MAGIC &&
+		header[1] > 0
+	) {
+		records->data = malloc(sizeof(TuningRecord) * header[1]);
+
+		if (
+			records->data != NULL &&
+			fread(records->data, sizeof(TuningRecord), header[1], file_descriptor) == header[1]
+		) {
+			records->count = header[1];
+		}
+	}
+
+	fclose(file_descriptor);
+}
+static TuningRecord *_find_record(const TuningRecords *records, const uint8_t device_uuid[VK_UUID_SIZE], uint32_t driver_version)
+{
+	for (uint32_t i = 0; i < records->count; i += 1)
+	{
+		if (
+			records->data[i].driver_version == driver_version &&
+			memcmp(records->data[i].device_uuid, device_uuid, VK_UUID_SIZE) == 0
+		) {
+			return records->data + i;
+		}
+	}
+
+	return NULL;
+}
+
+/* Module interface */
+
+bool load_tuned_workgroup_size(
+	const uint8_t device_uuid[VK_UUID_SIZE],
+	uint32_t driver_version,
+
+	uint32_t *workgroup_size
+) {
+	char path[CACHE_FILE_PATH_SIZE];
+
+	if (!get_cache_file_path(COMPUTE_TUNING_CACHE_FILE_NAME, path, sizeof(path)))
+	{
+		return false;
+	}
+
+	TuningRecords records;
+	_read_records(path, &records);
+
+	TuningRecord *record = _find_record(&records, device_uuid, driver_version);
+
+	bool result = record != NULL && record->workgroup_size > 0;
+
+	if (result)
+	{
+		*workgroup_size = record->workgroup_size;
+	}
+
+	free(records.data);
+
+	return result;
+}
+bool store_tuned_workgroup_size(
+	const uint8_t device_uuid[VK_UUID_SIZE],
+	uint32_t driver_version,
+	uint32_t workgroup_size
+) {
+	char path[CACHE_FILE_PATH_SIZE];
+
+	if (!get_cache_file_path(COMPUTE_TUNING_CACHE_FILE_NAME, path, sizeof(path)))
+	{
+		return false;
+	}
+
+	TuningRecords records;
+	_read_records(path, &records);
+
+	TuningRecord *record = _find_record(&records, device_uuid, driver_version);
+
+	if (record == NULL)
+	{
+		TuningRecord *data = realloc(records.data, sizeof(TuningRecord) * (records.count + 1));
+
+		if (data == NULL)
+		{
+			free(records.data);
+
+			return false;
+		}
+
+		records.data = data;
+		record = records.data + records.count;
+		records.count += 1;
+
+		memset(record, 0, sizeof(TuningRecord));
+		memcpy(record->device_uuid, device_uuid, VK_UUID_SIZE);
+		record->driver_version = driver_version;
+	}
+
+	record->workgroup_size = workgroup_size;
+
+	uint32_t header[2] = { COMPUTE_TUNING_CACHE_MAGIC, records.count };
+	size_t size = sizeof(header) + sizeof(TuningRecord) * records.count;
+
+	uint8_t *data = malloc(size);
+	bool result = data != NULL;
+
+	if (result)
+	{
+		memcpy(data, header, sizeof(header));
+		memcpy(data + sizeof(header), records.data, sizeof(TuningRecord) * records.count);
+
+		result = write_file_atomically(path, data, size);
+	}
+
+	free(data);
+	free(records.data);
+
+	return result;
+}
@@ -0,0 +1,531 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_memory.h"
+
+#define DEFAULT_BLOCK_SIZE 67108864  /* 64 MiB */
+#define MIN_BLOCK_SIZE 1048576       /* 1 MiB */
+#define MIN_NODE_SIZE 256
+#define MAX_BUDDY_ORDERS 32
+#define MEMORY_POOLS_COUNT (VK_MAX_MEMORY_TYPES * 2)
+
+typedef struct MemoryBlock
+{
+	VkDeviceMemory memory;
+	char *mapped;
+
+	/*
+		free_bitmaps[k] has a bit per node of order k,
+		set bit means the node is free and not split.
+	*/
+	uint64_t *free_bitmaps[MAX_BUDDY_ORDERS];
+	uint32_t free_counts[MAX_BUDDY_ORDERS];
+
+	uint32_t allocation_count;
+
+} MemoryBlock;
+
+/*
+	Blocks of a single memory type holding either linear
+	or optimal resources only.
+*/
+typedef struct MemoryPool
+{
+	MemoryBlock *blocks;
+	uint32_t count;
+
+	VkDeviceSize block_size;
+	uint32_t order_count;
+	uint32_t memory_type_idx;
+	bool host_visible;
+
+} MemoryPool;
+
+/* Module state */
+
+static VkDevice _device;
+static VkPhysicalDeviceMemoryProperties _memory_properties;
+static MemoryPool _pools[MEMORY_POOLS_COUNT];
+static DeviceMemoryStats _stats;
+
+/* Helper functions */
+
+static bool _is_node_free(const MemoryBlock *block, uint32_t order, uint32_t node_idx)
+{
+	return (block->free_bitmaps[order][node_idx / 64] >> (node_idx % 64)) & 1;
+}
+static void _mark_node_free(MemoryBlock *block, uint32_t order, uint32_t node_idx)
+{
+	block->free_bitmaps[order][node_idx / 64] |= (uint64_t)1 << (node_idx % 64);
+	block->free_counts[order] += 1;
+}
+static void _mark_node_taken(MemoryBlock *block, uint32_t order, uint32_t node_idx)
+{
+	block->free_bitmaps[order][node_idx / 64] &= ~((uint64_t)1 << (node_idx % 64));
+	block->free_counts[order] -= 1;
+}
+static uint32_t _find_free_node(const MemoryBlock *block, const MemoryPool *pool, uint32_t order)
+{
+	uint32_t node_count = 1u << (pool->order_count - 1 - order);
+	uint32_t word_count = (node_count + 63) / 64;
+
+	for (uint32_t i = 0; i < word_count; i += 1)
+	{
+		uint64_t word = block->free_bitmaps[order][i];
+
+		if (word != 0)
+		{
+			return i * 64 + (uint32_t)__builtin_ctzll(word);
+		}
+	}
+
+	return UINT32_MAX;
+}
+static uint32_t _get_order(VkDeviceSize size)
+{
+	uint32_t order = 0;
+
+	while (((VkDeviceSize)MIN_NODE_SIZE << order) < size)
+	{
+		order += 1;
+	}
+
+	return order;
+}
+static bool _create_block(MemoryPool *pool, uint32_t *block_idx)
+{
+	uint32_t idx = pool->count;
+
+	/*
+		Reuse slot of a released block, so that block indices
+		of live allocations stay valid.
+	*/
+	for (uint32_t i = 0; i < pool->count; i += 1)
+	{
+		if (pool->blocks[i].memory == VK_NULL_HANDLE)
+		{
+			idx = i;
+			break;
+		}
+	}
+
+	if (idx == pool->count)
+	{
+		MemoryBlock *blocks = realloc(pool->blocks, sizeof(MemoryBlock) * (pool->count + 1));
+
+		if (blocks == NULL)
+		{
+			return false;
+		}
+
+		pool->blocks = blocks;
+		pool->count += 1;
+	}
+
+	MemoryBlock *block = pool->blocks + idx;
+
+	memset(block, 0, sizeof(MemoryBlock));
+
+	VkMemoryAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = pool->block_size,
+		.memoryTypeIndex = pool->memory_type_idx,
+	};
+
+	if (vkAllocateMemory(_device, &allocate_info, NULL, &(block->memory)) != VK_SUCCESS)
+	{
+		block->memory = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	if (
+		pool->host_visible &&
+		vkMapMemory(_device, block->memory, 0, VK_WHOLE_SIZE, 0, (void **)&(block->mapped)) != VK_SUCCESS
+	) {
+		vkFreeMemory(_device, block->memory, NULL);
+		block->memory = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	/*
+		All bitmaps share one host allocation.
+	*/
+	uint32_t total_words = 0;
+
+	for (uint32_t order = 0; order < pool->order_count; order += 1)
+	{
+		total_words += ((1u << (pool->order_count - 1 - order)) + 63) / 64;
+	}
+
+	uint64_t *bitmaps = calloc(total_words, sizeof(uint64_t));
+
+	if (bitmaps == NULL)
+	{
+		vkFreeMemory(_device, block->memory, NULL);
+		block->memory = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	for (uint32_t order = 0; order < pool->order_count; order += 1)
+	{
+		block->free_bitmaps[order] = bitmaps;
+		bitmaps += ((1u << (pool->order_count - 1 - order)) + 63) / 64;
+	}
+
+	_mark_node_free(block, pool->order_count - 1, 0);
+
+	_stats.block_count += 1;
+	_stats.reserved_bytes += pool->block_size;
+
+	*block_idx = idx;
+
+	return true;
+}
+static void _destroy_block(MemoryPool *pool, MemoryBlock *block)
+{
+	vkFreeMemory(_device, block->memory, NULL);
+	free(block->free_bitmaps[0]);
+
+	memset(block, 0, sizeof(MemoryBlock));
+
+	_stats.block_count -= 1;
+	_stats.reserved_bytes -= pool->block_size;
+}
+/*
+	Take the smallest free node of at least the required order
+	and split it down, freeing right halves on the way.
+*/
+static bool _allocate_from_block(MemoryPool *pool, MemoryBlock *block, uint32_t order, VkDeviceSize *offset)
+{
+	uint32_t free_order = order;
+
+	while (free_order < pool->order_count && block->free_counts[free_order] == 0)
+	{
+		free_order += 1;
+	}
+
+	if (free_order == pool->order_count)
+	{
+		return false;
+	}
+
+	uint32_t node_idx = _find_free_node(block, pool, free_order);
+
+	_mark_node_taken(block, free_order, node_idx);
+
+	while (free_order > order)
+	{
+		free_order -= 1;
+		node_idx *= 2;
+
+		_mark_node_free(block, free_order, node_idx + 1);
+	}
+
+	*offset = ((VkDeviceSize)node_idx << order) * MIN_NODE_SIZE;
+
+	return true;
+}
+/*
+	Return node to the block merging it with its buddy
+	for as long as the buddy is free as well.
+*/
+static void _free_to_block(MemoryPool *pool, MemoryBlock *block, uint32_t order, VkDeviceSize offset)
+{
+	uint32_t node_idx = (uint32_t)((offset / MIN_NODE_SIZE) >> order);
+
+	while (order < pool->order_count - 1)
+	{
+		uint32_t buddy_idx = node_idx ^ 1;
+
+		if (!_is_node_free(block, order, buddy_idx))
+		{
+			break;
+		}
+
+		_mark_node_taken(block, order, buddy_idx);
+
+		node_idx /= 2;
+		order += 1;
+	}
+
+	_mark_node_free(block, order, node_idx);
+}
+static bool _allocate_dedicated(uint32_t memory_type_idx, VkDeviceSize size, DeviceMemoryAllocation *allocation)
+{
+	VkMemoryAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = size,
+		.memoryTypeIndex = memory_type_idx,
+	};
+
+	if (vkAllocateMemory(_device, &allocate_info, NULL, &(allocation->memory)) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	allocation->offset = 0;
+	allocation->size = size;
+	allocation->mapped = NULL;
+	allocation->block_idx = DEDICATED_ALLOCATION_BLOCK_IDX;
+	allocation->order = 0;
+
+	VkMemoryPropertyFlags flags = _memory_properties.memoryTypes[memory_type_idx].propertyFlags;
+
+	if (
+		(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+		vkMapMemory(_device, allocation->memory, 0, VK_WHOLE_SIZE, 0, &(allocation->mapped)) != VK_SUCCESS
+	) {
+		vkFreeMemory(_device, allocation->memory, NULL);
+
+		return false;
+	}
+
+	_stats.dedicated_allocation_count += 1;
+	_stats.reserved_bytes += size;
+	_stats.used_bytes += size;
+
+	return true;
+}
+static bool _allocate_from_pool(uint32_t pool_idx, const VkMemoryRequirements *requirements, DeviceMemoryAllocation *allocation)
+{
+	MemoryPool *pool = _pools + pool_idx;
+
+	VkDeviceSize node_size = requirements->size;
+
+	/*
+		Buddy nodes are aligned to their own size.
+	*/
+	if (requirements->alignment > node_size)
+	{
+		node_size = requirements->alignment;
+	}
+
+	allocation->pool_idx = pool_idx;
+
+	if (node_size > pool->block_size / 2)
+	{
+		return _allocate_dedicated(pool->memory_type_idx, requirements->size, allocation);
+	}
+
+	uint32_t order = _get_order(node_size);
+	VkDeviceSize offset = 0;
+	uint32_t block_idx = UINT32_MAX;
+
+	for (uint32_t i = 0; i < pool->count; i += 1)
+	{
+		if (
+			pool->blocks[i].memory != VK_NULL_HANDLE &&
+			_allocate_from_block(pool, pool->blocks + i, order, &offset)
+		) {
+			block_idx = i;
+			break;
+		}
+	}
+
+	if (block_idx == UINT32_MAX)
+	{
+		if (!_create_block(pool, &block_idx))
+		{
+			return false;
+		}
+
+		_allocate_from_block(pool, pool->blocks + block_idx, order, &offset);
+	}
+
+	MemoryBlock *block = pool->blocks + block_idx;
+
+	block->allocation_count += 1;
+
+	allocation->memory = block->memory;
+	allocation->offset = offset;
+	allocation->size = requirements->size;
+	allocation->mapped = block->mapped ? block->mapped + offset : NULL;
+	allocation->block_idx = block_idx;
+	allocation->order = order;
+
+	_stats.used_bytes += (VkDeviceSize)MIN_NODE_SIZE << order;
+
+	return true;
+}
+
+/* Module interface */
+
+bool setup_device_memory(VkPhysicalDevice physical_device, VkDevice device)
+{
+	_device = device;
+
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &_memory_properties);
+
+	memset(_pools, 0, sizeof(_pools));
+	memset(&_stats, 0, sizeof(_stats));
+
+	for (uint32_t i = 0; i < _memory_properties.memoryTypeCount; i += 1)
+	{
+		const VkMemoryType *memory_type = _memory_properties.memoryTypes + i;
+		VkDeviceSize heap_size = _memory_properties.memoryHeaps[memory_type->heapIndex].size;
+
+		/*
+			Small heaps (e.g. host visible device local window)
+			must not be eaten by a couple of blocks.
+		*/
+		VkDeviceSize block_size = DEFAULT_BLOCK_SIZE;
+
+		while (block_size > MIN_BLOCK_SIZE && block_size > heap_size / 8)
+		{
+			block_size /= 2;
+		}
+
+		uint32_t order_count = 1;
+
+		while (((VkDeviceSize)MIN_NODE_SIZE << (order_count - 1)) < block_size)
+		{
+			order_count += 1;
+		}
+
+		for (uint32_t j = 0; j < 2; j += 1)
+		{
+			MemoryPool *pool = _pools + i * 2 + j;
+
+			pool->block_size = block_size;
+			pool->order_count = order_count;
+			pool->memory_type_idx = i;
+			pool->host_visible = (memory_type->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+		}
+	}
+
+	return true;
+}
+void clear_device_memory()
+{
+	for (uint32_t i = 0; i < MEMORY_POOLS_COUNT; i += 1)
+	{
+		MemoryPool *pool = _pools + i;
+
+		for (uint32_t j = 0; j < pool->count; j += 1)
+		{
+			if (pool->blocks[j].memory != VK_NULL_HANDLE)
+			{
+				_destroy_block(pool, pool->blocks + j);
+			}
+		}
+
+		free(pool->blocks);
+
+		pool->blocks = NULL;
+		pool->count = 0;
+	}
+}
+bool allocate_device_memory(
+	const VkMemoryRequirements *requirements,
+	VkMemoryPropertyFlags properties,
+	bool linear_resource,
+
+	DeviceMemoryAllocation *allocation
+) {
+	for (uint32_t i = 0; i < _memory_properties.memoryTypeCount; i += 1)
+	{
+		if (
+			(requirements->memoryTypeBits & (1u << i)) &&
+			(_memory_properties.memoryTypes[i].propertyFlags & properties) == properties &&
+			_allocate_from_pool(i * 2 + (linear_resource ? 0 : 1), requirements, allocation)
+		) {
+			_stats.allocation_count += 1;
+			_stats.requested_bytes += requirements->size;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+void free_device_memory(DeviceMemoryAllocation *allocation)
+{
+	if (allocation->memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	MemoryPool *pool = _pools + allocation->pool_idx;
+
+	_stats.allocation_count -= 1;
+	_stats.requested_bytes -= allocation->size;
+
+	if (allocation->block_idx == DEDICATED_ALLOCATION_BLOCK_IDX)
+	{
+		vkFreeMemory(_device, allocation->memory, NULL);
+
+		_stats.dedicated_allocation_count -= 1;
+		_stats.reserved_bytes -= allocation->size;
+		_stats.used_bytes -= allocation->size;
+	}
+	else
+	{
+		MemoryBlock *block = pool->blocks + allocation->block_idx;
+
+		_free_to_block(pool, block, allocation->order, allocation->offset);
+
+		block->allocation_count -= 1;
+
+		_stats.used_bytes -= (VkDeviceSize)MIN_NODE_SIZE << allocation->order;
+
+		/*
+			Keep the first block of a pool around to avoid
+			allocate/free churn on the driver.
+		*/
+		if (block->allocation_count == 0 && allocation->block_idx != 0)
+		{
+			_destroy_block(pool, block);
+		}
+	}
+
+	memset(allocation, 0, sizeof(DeviceMemoryAllocation));
+}
+void get_device_memory_stats(DeviceMemoryStats *stats)
+{
+	*stats = _stats;
+
+	VkDeviceSize free_bytes = 0;
+	VkDeviceSize largest_free_bytes = 0;
+
+	stats->largest_free_range = 0;
+
+	for (uint32_t i = 0; i < MEMORY_POOLS_COUNT; i += 1)
+	{
+		const MemoryPool *pool = _pools + i;
+
+		for (uint32_t j = 0; j < pool->count; j += 1)
+		{
+			const MemoryBlock *block = pool->blocks + j;
+			VkDeviceSize block_largest_free_range = 0;
+
+			if (block->memory == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+
+			for (uint32_t order = 0; order < pool->order_count; order += 1)
+			{
+				VkDeviceSize node_size = (VkDeviceSize)MIN_NODE_SIZE << order;
+
+				free_bytes += node_size * block->free_counts[order];
+
+				if (block->free_counts[order] > 0)
+				{
+					block_largest_free_range = node_size;
+				}
+			}
+
+			largest_free_bytes += block_largest_free_range;
+
+			if (block_largest_free_range > stats->largest_free_range)
+			{
+				stats->largest_free_range = block_largest_free_range;
+			}
+		}
+	}
+
+	stats->fragmentation = free_bytes > 0 ? 1.0f - (float)largest_free_bytes / (float)free_bytes : 0.0f;
+}
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_profiler.h"
+
+#define NO_PASS_IDX UINT32_MAX
+
+typedef struct ProfilerFrame
+{
+	VkQueryPool query_pool;
+
+	/*
+		Pass every timestamp closes, or the timeline it begins.
+	*/
+	const char *names[GPU_PROFILER_MAX_TIMESTAMPS];
+	bool begins_timeline[GPU_PROFILER_MAX_TIMESTAMPS];
+	uint32_t timestamp_count;
+
+	/*
+		Recorded and not collected yet.
+	*/
+	bool is_pending;
+
+} ProfilerFrame;
+
+/* Module state */
+
+static VkDevice _device;
+static ProfilerFrame *_frames;
+static uint32_t _frames_count;
+static ProfilerFrame *_recorded_frame;
+
+static double _milliseconds_per_tick;
+static uint64_t _timestamp_mask;
+static uint32_t _log_interval;
+
+static GpuProfilerStats _stats;
+
+/*
+	Per pass of _stats, sum over the collected frames and time in the frame
+	being collected, negative while the pass has not shown up in it.
+*/
+static double _total_milliseconds[GPU_PROFILER_MAX_PASSES];
+static double _frame_milliseconds[GPU_PROFILER_MAX_PASSES];
+
+/* Helper functions */
+
+/*
+	Unknown names are added, NO_PASS_IDX once the table is full.
+*/
+static uint32_t _find_pass(const char *name)
+{
+	for (uint32_t i = 0; i < _stats.pass_count; i += 1)
+	{
+		if (_stats.passes[i].name == name || strcmp(_stats.passes[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+
+	if (_stats.pass_count == GPU_PROFILER_MAX_PASSES)
+	{
+		return NO_PASS_IDX;
+	}
+
+	uint32_t pass_idx = _stats.pass_count;
+	_stats.pass_count += 1;
+
+	_stats.passes[pass_idx].name = name;
+	_stats.passes[pass_idx].last_milliseconds = -1.0;
+	_stats.passes[pass_idx].average_milliseconds = 0.0;
+	_stats.passes[pass_idx].max_milliseconds = 0.0;
+	_stats.passes[pass_idx].frame_count = 0;
+
+	_total_milliseconds[pass_idx] = 0.0;
+	_frame_milliseconds[pass_idx] = -1.0;
+
+	return pass_idx;
+}
+static void _add_frame_time(uint32_t pass_idx, double milliseconds)
+{
+	if (pass_idx == NO_PASS_IDX)
+	{
+		return;
+	}
+
+	if (_frame_milliseconds[pass_idx] < 0.0)
+	{
+		_frame_milliseconds[pass_idx] = 0.0;
+	}
+
+	_frame_milliseconds[pass_idx] += milliseconds;
+}
+static void _write_timestamp(VkCommandBuffer command_buffer, const char *name, VkPipelineStageFlagBits stage, bool begins_timeline)
+{
+	ProfilerFrame *frame = _recorded_frame;
+
+	if (frame == NULL)
+	{
+		return;
+	}
+
+	if (frame->timestamp_count == GPU_PROFILER_MAX_TIMESTAMPS)
+	{
+		_stats.dropped_mark_count += 1;
+
+		return;
+	}
+
+	vkCmdWriteTimestamp(command_buffer, stage, frame->query_pool, frame->timestamp_count);
+
+	frame->names[frame->timestamp_count] = name;
+	frame->begins_timeline[frame->timestamp_count] = begins_timeline;
+	frame->timestamp_count += 1;
+}
+static void _log_stats()
+{
+	printf("GPU passes over %u frames:\n", _stats.frame_count);
+
+	for (uint32_t i = 0; i < _stats.pass_count; i += 1)
+	{
+		printf(
+			"\t%-32s %8.3f ms average, %8.3f ms max\n",
+			_stats.passes[i].name,
+			_stats.passes[i].average_milliseconds,
+			_stats.passes[i].max_milliseconds
+		);
+	}
+
+	if (_stats.dropped_mark_count > 0)
+	{
+		printf("\t%u marks dropped.\n", _stats.dropped_mark_count);
+	}
+}
+
+/* Module interface */
+
+bool setup_gpu_profiler(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family_idx, uint32_t frames_count, uint32_t log_interval)
+{
+	_device = device;
+	_frames = NULL;
+	_frames_count = 0;
+	_recorded_frame = NULL;
+	_log_interval = log_interval;
+
+	reset_gpu_profiler_stats();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	uint32_t queue_families_num = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_families_num, NULL);
+
+	VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_families_num);
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_families_num, queue_families);
+
+	uint32_t valid_bits = queue_family_idx < queue_families_num ? queue_families[queue_family_idx].timestampValidBits : 0;
+
+	free(queue_families);
+
+	if (valid_bits == 0)
+	{
+		return true;
+	}
+
+	_milliseconds_per_tick = (double)properties.limits.timestampPeriod * 1e-6;
+	_timestamp_mask = valid_bits >= 64 ? UINT64_MAX : (1ull << valid_bits) - 1;
+
+	_frames = (ProfilerFrame *)calloc(frames_count, sizeof(ProfilerFrame));
+
+	if (_frames == NULL)
+	{
+		return false;
+	}
+
+	_frames_count = frames_count;
+
+	VkQueryPoolCreateInfo query_pool_ci = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = GPU_PROFILER_MAX_TIMESTAMPS,
+	};
+
+	for (uint32_t i = 0; i < _frames_count; i += 1)
+	{
+		if (vkCreateQueryPool(_device, &query_pool_ci, NULL, &(_frames[i].query_pool)) != VK_SUCCESS)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+void clear_gpu_profiler()
+{
+	for (uint32_t i = 0; i < _frames_count; i += 1)
+	{
+		vkDestroyQueryPool(_device, _frames[i].query_pool, NULL);
+	}
+
+	free(_frames);
+
+	_frames = NULL;
+	_frames_count = 0;
+	_recorded_frame = NULL;
+}
+bool is_gpu_profiler_supported()
+{
+	return _frames != NULL;
+}
+void begin_gpu_profiler_frame(VkCommandBuffer command_buffer, uint32_t frame_idx)
+{
+	if (_frames == NULL)
+	{
+		return;
+	}
+
+	_recorded_frame = _frames + frame_idx;
+	_recorded_frame->timestamp_count = 0;
+	_recorded_frame->is_pending = true;
+
+	vkCmdResetQueryPool(command_buffer, _recorded_frame->query_pool, 0, GPU_PROFILER_MAX_TIMESTAMPS);
+}
+void begin_gpu_timeline(VkCommandBuffer command_buffer, const char *name)
+{
+	_write_timestamp(command_buffer, name, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, true);
+}
+/*
+	Bottom of pipe waits for every command recorded before the mark.
+*/
+void mark_gpu_pass(VkCommandBuffer command_buffer, const char *name)
+{
+	_write_timestamp(command_buffer, name, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, false);
+}
+bool collect_gpu_profiler_frame(uint32_t frame_idx)
+{
+	if (_frames == NULL || !_frames[frame_idx].is_pending)
+	{
+		return false;
+	}
+
+	ProfilerFrame *frame = _frames + frame_idx;
+	uint64_t timestamps[GPU_PROFILER_MAX_TIMESTAMPS];
+
+	frame->is_pending = false;
+
+	/*
+		Logged before the next frame is collected,
+		last times of the logged frame stay readable until then.
+	*/
+	if (_log_interval > 0 && _stats.frame_count >= _log_interval)
+	{
+		_log_stats();
+
+		reset_gpu_profiler_stats();
+	}
+
+	/*
+		No wait flag, the fence of the frame already covers every query.
+	*/
+	if (
+		frame->timestamp_count == 0 ||
+		vkGetQueryPoolResults(
+			_device,
+			frame->query_pool,
+			0, frame->timestamp_count,
+			sizeof(uint64_t) * frame->timestamp_count, timestamps, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT
+		) != VK_SUCCESS
+	) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < _stats.pass_count; i += 1)
+	{
+		_frame_milliseconds[i] = -1.0;
+	}
+
+	uint32_t timeline_pass_idx = NO_PASS_IDX;
+	uint64_t previous_timestamp = 0;
+
+	for (uint32_t i = 0; i < frame->timestamp_count; i += 1)
+	{
+		uint32_t pass_idx = _find_pass(frame->names[i]);
+
+		if (frame->begins_timeline[i])
+		{
+			timeline_pass_idx = pass_idx;
+			previous_timestamp = timestamps[i];
+
+			_add_frame_time(timeline_pass_idx, 0.0);
+
+			continue;
+		}
+
+		double milliseconds = (double)((timestamps[i] - previous_timestamp) & _timestamp_mask) * _milliseconds_per_tick;
+
+		_add_frame_time(pass_idx, milliseconds);
+		_add_frame_time(timeline_pass_idx, milliseconds);
+
+		previous_timestamp = timestamps[i];
+	}
+
+	_stats.frame_count += 1;
+
+	for (uint32_t i = 0; i < _stats.pass_count; i += 1)
+	{
+		GpuPassStats *pass = _stats.passes + i;
+
+		pass->last_milliseconds = _frame_milliseconds[i];
+
+		if (_frame_milliseconds[i] < 0.0)
+		{
+			continue;
+		}
+
+		pass->frame_count += 1;
+
+		_total_milliseconds[i] += _frame_milliseconds[i];
+
+		pass->average_milliseconds = _total_milliseconds[i] / pass->frame_count;
+		pass->max_milliseconds = _frame_milliseconds[i] > pass->max_milliseconds ? _frame_milliseconds[i] : pass->max_milliseconds;
+	}
+
+	return true;
+}
+double get_gpu_pass_milliseconds(const char *name)
+{
+	for (uint32_t i = 0; i < _stats.pass_count; i += 1)
+	{
+		if (_stats.passes[i].name == name || strcmp(_stats.passes[i].name, name) == 0)
+		{
+			return _stats.passes[i].last_milliseconds;
+		}
+	}
+
+	return -1.0;
+}
+const GpuProfilerStats *get_gpu_profiler_stats()
+{
+	return &_stats;
+}
+void reset_gpu_profiler_stats()
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
@@ -99,10 +99,26 @@ Quaternion get_multiplied_q(const Quaternion *p, const Quaternion *q)
 
 	return result;
 }
+/*
+	Column-major storage, result = m0 * m1.
+*/
 Matrix4x4 get_multiplied_m(const Matrix4x4 *m0, const Matrix4x4 *m1)
 {
 	Matrix4x4 result;
 
+	for (int column = 0; column < 4; column += 1)
+	{
+		for (int row = 0; row < 4; row += 1)
+		{
+			result.data[column * 4 + row] = (
+				m0->data[ 0 + row] * m1->data[column * 4 + 0] +
+				m0->data[ 4 + row] * m1->data[column * 4 + 1] +
+				m0->data[ 8 + row] * m1->data[column * 4 + 2] +
+				m0->data[12 + row] * m1->data[column * 4 + 3]
+			);
+		}
+	}
+
 	return result;
 }
 
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline_cache.h"
+#include "cache_files.h"
+
+/*
+	Header every pipeline cache blob starts with,
+	VK_PIPELINE_CACHE_HEADER_VERSION_ONE layout.
+*/
+typedef struct PipelineCacheHeader
+{
+	uint32_t header_size;
+	uint32_t header_version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+
+} PipelineCacheHeader;
+
+/* Module state */
+
+static VkDevice _device;
+static VkPipelineCache _pipeline_cache;
+static bool _is_warm;
+
+/*
+	Empty without a cache directory, the cache then lives in memory only.
+*/
+static char _file_path[CACHE_FILE_PATH_SIZE];
+
+/* Helper functions */
+
+/*
+	Missing or unreadable file reads as no data.
+*/
+static void _read_blob(void **data, size_t *size)
+{
+	*data = NULL;
+	*size = 0;
+
+	FILE *file_descriptor = _file_path[0] != '\0' ? fopen(_file_path, "rb") : NULL;
+
+	if (!file_descriptor)
+	{
+		return;
+	}
+
+	long file_size = -1;
+
+	if (fseek(file_descriptor, 0, SEEK_END) == 0)
+	{
+		file_size = ftell(file_descriptor);
+	}
+
+	if (file_size > 0 && fseek(file_descriptor, 0, SEEK_SET) == 0)
+	{
+		*data = malloc((size_t)file_size);
+
+		if (*data != NULL && fread(*data, (size_t)file_size, 1, file_descriptor) == 1)
+		{
+			*size = (size_t)file_size;
+		}
+		else
+		{
+			free(*data);
+			*data = NULL;
+		}
+	}
+
+	fclose(file_descriptor);
+}
+/*
+	Drivers should reject foreign blobs themselves,
+	checking the header first does not rely on it.
+*/
+static bool _is_blob_compatible(const void *data, size_t size, const VkPhysicalDeviceProperties *properties)
+{
+	PipelineCacheHeader header;
+
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	return (
+		header.header_size >= sizeof(header) &&
+		header.header_size <= size &&
+		header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendor_id == properties->vendorID &&
+		header.device_id == properties->deviceID &&
+		memcmp(header.pipeline_cache_uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0
+	);
+}
+
+/* Module interface */
+
+bool setup_pipeline_cache(VkPhysicalDevice physical_device, VkDevice device)
+{
+	_device = device;
+	_pipeline_cache = VK_NULL_HANDLE;
+	_is_warm = false;
+
+	if (!get_cache_file_path(PIPELINE_CACHE_FILE_NAME, _file_path, sizeof(_file_path)))
+	{
+		_file_path[0] = '\0';
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	void *data;
+	size_t size;
+	_read_blob(&data, &size);
+
+	_is_warm = data != NULL && _is_blob_compatible(data, size, &properties);
+
+	VkPipelineCacheCreateInfo pipeline_cache_ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = _is_warm ? size : 0,
+		.pInitialData = _is_warm ? data : NULL,
+	};
+
+	VkResult result = vkCreatePipelineCache(_device, &pipeline_cache_ci, NULL, &_pipeline_cache);
+
+	/*
+		Blob the driver still refuses is dropped, an empty cache works as well.
+	*/
+	if (result != VK_SUCCESS && _is_warm)
+	{
+		_is_warm = false;
+
+		pipeline_cache_ci.initialDataSize = 0;
+		pipeline_cache_ci.pInitialData = NULL;
+
+		result = vkCreatePipelineCache(_device, &pipeline_cache_ci, NULL, &_pipeline_cache);
+	}
+
+	free(data);
+
+	return result == VK_SUCCESS;
+}
+void clear_pipeline_cache()
+{
+	vkDestroyPipelineCache(_device, _pipeline_cache, NULL);
+
+	_pipeline_cache = VK_NULL_HANDLE;
+	_is_warm = false;
+}
+VkPipelineCache get_pipeline_cache()
+{
+	return _pipeline_cache;
+}
+bool is_pipeline_cache_warm()
+{
+	return _is_warm;
+}
+bool store_pipeline_cache()
+{
+	size_t size = 0;
+
+	if (_file_path[0] == '\0' || _pipeline_cache == VK_NULL_HANDLE || vkGetPipelineCacheData(_device, _pipeline_cache, &size, NULL) != VK_SUCCESS || size == 0)
+	{
+		return false;
+	}
+
+	void *data = malloc(size);
+
+	/*
+		VK_INCOMPLETE would leave a blob without its tail, it is not written.
+	*/
+	if (data == NULL || vkGetPipelineCacheData(_device, _pipeline_cache, &size, data) != VK_SUCCESS)
+	{
+		free(data);
+
+		return false;
+	}
+
+	bool result = write_file_atomically(_file_path, data, size);
+
+	free(data);
+
+	return result;
+}
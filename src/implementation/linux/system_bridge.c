@@ -1,16 +1,42 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "system_bridge.h"
 #include "math3d.h"
+#include "upload_manager.h"
+#include "compute_tuning.h"
+#include "pipeline_cache.h"
+#include "embedded_shaders.h"
+#include "gpu_profiler.h"
 
 #define DEVICE_QUEUES_COUNT 3
 #define GPU_DATA_BINDINGS_COUNT 4
+#define PHYSICS_DATA_BINDINGS_COUNT 12
 #define PARTICLE_COUNT 8
 #define PHYSICAL_DEVICE_EXTENSIONS_COUNT 1
 #define VALIDATION_LAYERS_COUNT 1
+#define UPLOAD_STAGING_SIZE 33554432  /* 32 MiB */
+#define DEFAULT_COMPUTE_WORKGROUP_SIZE 64
+#define COMPUTE_TUNING_CANDIDATES_COUNT 4
+#define COMPUTE_TUNING_DISPATCHES_COUNT 8
+#define COMPUTE_TUNING_RUNS_COUNT 3
+#define COMPUTE_TUNING_PARTICLE_COUNT 1048576
+#define QUAD_STRIP_VERTICES_COUNT 4
+#define DEFAULT_SPAWN_BUFFER_CAPACITY 1024
+#define SORT_DATA_BINDINGS_COUNT 6
+#define RADIX_SORT_WORKGROUP_SIZE 256  /* one invocation per 8 bit digit */
+#define RADIX_SORT_MAX_GROUP_COUNT 1024
+#define RADIX_SORT_PASSES_COUNT 4
+#define FLUID_DATA_BINDINGS_COUNT 9
+#define FLUID_GRID_SCAN_BLOCK_SIZE 1024
+#define FLUID_GRID_MAX_TABLE_SIZE (FLUID_GRID_SCAN_BLOCK_SIZE * FLUID_GRID_SCAN_BLOCK_SIZE)
+#define GRAVITY_TREE_DATA_BINDINGS_COUNT 4
+#define MAX_FRAMES_IN_FLIGHT 32  /* bits of RetiredSwapChain.pending_frames_mask */
+#define MAX_RETIRED_SWAP_CHAINS 8
+#define OFFSCREEN_IMAGE_FORMAT VK_FORMAT_R8G8B8A8_UNORM
 
 /* Module state */
 
@@ -48,10 +74,13 @@ static Matrix4x4 _model = {
 	}
 };
 
+static Quaternion _model_rotation = { .x = 0.0f, .y = 0.0f, .z = 0.0f, .w = 1.0f };
+
 static OperationQueueFamilies _operation_queue_families = {
 	.graphics_family_idx = -1,
 	.compute_family_idx = -1,
 	.present_family_idx = -1,
+	.transfer_family_idx = -1,
 
 	.use_same_family = false,
 };
@@ -76,6 +105,7 @@ static VkDevice _device;
 static VkQueue _graphics_queue;
 static VkQueue _compute_queue;
 static VkQueue _present_queue;
+static VkQueue _transfer_queue;
 static VkRenderPass _render_pass;
 static VkCommandPool _long_live_buffers_pool;
 static VkCommandPool _one_time_buffers_pool;
@@ -83,7 +113,11 @@ static CommandBuffers _command_buffers;
 
 static uint32_t _one_time_command_buffer_idx;
 static uint32_t _image_draw_command_buffers_begin_idx;
-static uint32_t _compute_command_buffer_idx;
+static uint32_t _compute_command_buffers_begin_idx;
+
+static RenderSettings _render_settings;
+static Frames _frames;
+static uint32_t _frame_idx;
 
 static VkSwapchainKHR _swap_chain;
 
@@ -93,57 +127,229 @@ static SwapChainImages _swap_chain_images;
 static SwapChainImageViews _swap_chain_image_views;
 static SwapChainFramebuffers _swap_chain_framebuffers;
 
+/*
+	Resize only requests recreation, the frame loop recreates the swap chain
+	before acquiring the next image. Replaced swap chains wait here until
+	no frame in flight uses them.
+*/
+static bool _swap_chain_resize_requested;
+static RetiredSwapChain _retired_swap_chains[MAX_RETIRED_SWAP_CHAINS];
+static uint32_t _retired_swap_chains_count;
+
+/*
+	Only swap chain image of headless rendering.
+*/
+static VkImage _offscreen_image;
+static DeviceMemoryAllocation _offscreen_image_memory;
+
 static VkImage _depth_image;
 static VkImageView _depth_image_view;
 static VkFormat _depth_image_format;
-static VkDeviceMemory _depth_image_memory;
+static DeviceMemoryAllocation _depth_image_memory;
 
 static VkDescriptorPool _descriptor_pool;
 static VkDescriptorSetLayout _descriptor_set_layout;
-static VkDescriptorSet _descriptor_set;
+static VkDescriptorSetLayout _physics_descriptor_set_layout;
+static VkDescriptorSetLayout _sort_descriptor_set_layout;
+static VkDescriptorSetLayout _fluid_descriptor_set_layout;
+static VkDescriptorSet _fluid_descriptor_set;
+static VkDescriptorSetLayout _gravity_tree_descriptor_set_layout;
+static VkDescriptorSet _gravity_tree_descriptor_set;
+
+/*
+	Radix sort passes read keys and values of set i and write set 1 - i.
+*/
+static VkDescriptorSet _sort_descriptor_sets[2];
 
 static VkPipelineLayout _graphics_pipeline_layout;
 static VkPipeline _graphics_pipeline;
 
 static VkShaderModule _vertex_shader;
-static char *_vertex_shader_code;
 static VkShaderModule _fragment_shader;
-static char *_fragment_shader_code;
 static VkShaderModule _compute_shader;
-static char *_compute_shader_code;
+static VkShaderModule _physics_shader;
+static VkShaderModule _emit_shader;
+static VkShaderModule _gravity_direct_shader;
+static VkShaderModule _gravity_tree_arguments_shader;
+static VkShaderModule _gravity_tree_bounds_shader;
+static VkShaderModule _gravity_tree_morton_shader;
+static VkShaderModule _gravity_tree_radix_histogram_shader;
+static VkShaderModule _gravity_tree_radix_scan_shader;
+static VkShaderModule _gravity_tree_radix_scatter_shader;
+static VkShaderModule _gravity_tree_build_shader;
+static VkShaderModule _gravity_tree_summarize_shader;
+static VkShaderModule _gravity_tree_forces_shader;
+static VkShaderModule _fluid_physics_shader;
+static VkShaderModule _grid_count_shader;
+static VkShaderModule _grid_scan_shader;
+static VkShaderModule _grid_scan_blocks_shader;
+static VkShaderModule _grid_scan_add_shader;
+static VkShaderModule _grid_scatter_shader;
+static VkShaderModule _sph_density_shader;
+static VkShaderModule _sph_forces_shader;
+static VkShaderModule _step_arguments_shader;
+static VkShaderModule _draw_arguments_shader;
+static VkShaderModule _cull_shader;
+static VkShaderModule _cull_arguments_shader;
+static VkShaderModule _sort_arguments_shader;
+static VkShaderModule _radix_histogram_shader;
+static VkShaderModule _radix_scan_shader;
+static VkShaderModule _radix_scatter_shader;
+static VkShaderModule _sort_gather_shader;
 
 static VkPipelineLayout _compute_pipeline_layout;
 static VkPipeline _compute_pipeline;
-static VkFence _compute_finished_fence;
-
-static VkBuffer _host_uniform_data_buffer;
-static VkDeviceMemory _host_uniform_data_buffer_memory;
-static VkBuffer _device_uniform_data_buffer;
-static VkDeviceMemory _device_uniform_data_buffer_memory;
-
-static VkBuffer _device_vertex_buffer;
-static VkDeviceMemory _device_vertex_buffer_memory;
-static VkBuffer _host_vertex_buffer;
-static VkDeviceMemory _host_vertex_buffer_memory;
-
-static VkBuffer _device_index_buffer;
-static VkDeviceMemory _device_index_buffer_memory;
-static VkBuffer _host_index_buffer;
-static VkDeviceMemory _host_index_buffer_memory;
-
-static VkBuffer _device_particle_buffer;
-static VkDeviceMemory _device_particle_buffer_memory;
-static VkBuffer _host_particle_buffer;
-static VkDeviceMemory _host_particle_buffer_memory;
-
-static VkSemaphore _image_available;
-static VkSemaphore _render_finished;
-
-static Vertices _vertices;
-static Indices _indices;
-static UniformData _uniform_data;
+static uint32_t _compute_workgroup_size;
+
+static VkPipelineLayout _physics_pipeline_layout;
+static VkPipeline _physics_pipeline;
+static VkPipeline _emit_pipeline;
+static VkPipeline _step_arguments_pipeline;
+
+/*
+	Velocity kick of mutual gravity, after fluid passes and before physics.
+*/
+static VkPipeline _gravity_direct_pipeline;
+static VkPipeline _gravity_tree_arguments_pipeline;
+static VkPipeline _gravity_tree_bounds_pipeline;
+static VkPipeline _gravity_tree_morton_pipeline;
+static VkPipeline _gravity_tree_radix_histogram_pipeline;
+static VkPipeline _gravity_tree_radix_scan_pipeline;
+static VkPipeline _gravity_tree_radix_scatter_pipeline;
+static VkPipeline _gravity_tree_build_pipeline;
+static VkPipeline _gravity_tree_summarize_pipeline;
+static VkPipeline _gravity_tree_forces_pipeline;
+
+/*
+	Fluid passes of every step between emit and physics,
+	they share the physics layout with the fluid set second.
+*/
+static VkPipeline _grid_count_pipeline;
+static VkPipeline _grid_scan_pipeline;
+static VkPipeline _grid_scan_blocks_pipeline;
+static VkPipeline _grid_scan_add_pipeline;
+static VkPipeline _grid_scatter_pipeline;
+static VkPipeline _sph_density_pipeline;
+static VkPipeline _sph_forces_pipeline;
+
+/*
+	Frame passes after the physics steps: culling, draw arguments
+	and depth sort of blended particles. Their layout shares the physics set,
+	the sort set comes second, and takes frame pass constants.
+*/
+static VkPipelineLayout _frame_pass_pipeline_layout;
+static VkPipeline _cull_arguments_pipeline;
+static VkPipeline _cull_pipeline;
+static VkPipeline _draw_arguments_pipeline;
+static VkPipeline _sort_arguments_pipeline;
+static VkPipeline _radix_histogram_pipeline;
+static VkPipeline _radix_scan_pipeline;
+static VkPipeline _radix_scatter_pipeline;
+static VkPipeline _sort_gather_pipeline;
+
+static VkBuffer _quad_vertex_buffer;
+static DeviceMemoryAllocation _quad_vertex_buffer_memory;
+
+/*
+	Particle state as one stream per attribute. Positions and velocities
+	ping-pong, _particle_state_idx holds the current ones. Colors only
+	change on emission, every step reads the same stream.
+*/
+static VkBuffer _particle_position_buffers[2];
+static DeviceMemoryAllocation _particle_position_buffers_memory[2];
+static VkBuffer _particle_velocity_buffers[2];
+static DeviceMemoryAllocation _particle_velocity_buffers_memory[2];
+static VkBuffer _particle_color_buffer;
+static DeviceMemoryAllocation _particle_color_buffer_memory;
+static uint32_t _particle_state_idx;
+
+/*
+	Alive list i is read by steps reading state i, dead slots are kept on a stack.
+*/
+static VkBuffer _alive_list_buffers[2];
+static DeviceMemoryAllocation _alive_list_buffers_memory[2];
+static VkBuffer _dead_list_buffer;
+static DeviceMemoryAllocation _dead_list_buffer_memory;
+static VkBuffer _particle_counters_buffer;
+static DeviceMemoryAllocation _particle_counters_buffer_memory;
+
+/*
+	Temporary radix sort storage shared by frames, every frame sorts
+	within its compute submit. Keys and values ping-pong between passes,
+	histograms are bounded by the maximal workgroup count.
+*/
+static VkBuffer _sort_key_buffers[2];
+static DeviceMemoryAllocation _sort_key_buffers_memory[2];
+static VkBuffer _sort_value_buffers[2];
+static DeviceMemoryAllocation _sort_value_buffers_memory[2];
+static VkBuffer _sort_histogram_buffer;
+static DeviceMemoryAllocation _sort_histogram_buffer_memory;
+static VkBuffer _sort_arguments_buffer;
+static DeviceMemoryAllocation _sort_arguments_buffer_memory;
+
+/*
+	Fluid storage shared by frames. Grid entries are indexed by alive list
+	position, densities and accelerations by particle slot, cell tables
+	by hash. Cell counts stay zero between grid builds.
+*/
+static VkBuffer _fluid_parameters_buffer;
+static DeviceMemoryAllocation _fluid_parameters_buffer_memory;
+static VkBuffer _grid_entry_buffer;
+static DeviceMemoryAllocation _grid_entry_buffer_memory;
+static VkBuffer _grid_cell_count_buffer;
+static DeviceMemoryAllocation _grid_cell_count_buffer_memory;
+static VkBuffer _grid_cell_start_buffer;
+static DeviceMemoryAllocation _grid_cell_start_buffer_memory;
+static VkBuffer _grid_cell_end_buffer;
+static DeviceMemoryAllocation _grid_cell_end_buffer_memory;
+static VkBuffer _grid_block_sum_buffer;
+static DeviceMemoryAllocation _grid_block_sum_buffer_memory;
+static VkBuffer _grid_sorted_particle_buffer;
+static DeviceMemoryAllocation _grid_sorted_particle_buffer_memory;
+static VkBuffer _fluid_density_buffer;
+static DeviceMemoryAllocation _fluid_density_buffer_memory;
+static VkBuffer _fluid_acceleration_buffer;
+static DeviceMemoryAllocation _fluid_acceleration_buffer_memory;
+static uint32_t _grid_table_size;
+
+/*
+	Barnes-Hut tree rebuilt every step over Morton codes sorted in the
+	radix sort buffers. Internal node i of the N - 1 ones is stored at i,
+	leaves are sorted keys.
+*/
+static VkBuffer _gravity_tree_bounds_buffer;
+static DeviceMemoryAllocation _gravity_tree_bounds_buffer_memory;
+static VkBuffer _gravity_tree_node_buffer;
+static DeviceMemoryAllocation _gravity_tree_node_buffer_memory;
+static VkBuffer _gravity_tree_leaf_parent_buffer;
+static DeviceMemoryAllocation _gravity_tree_leaf_parent_buffer_memory;
+static VkBuffer _gravity_tree_node_data_buffer;
+static DeviceMemoryAllocation _gravity_tree_node_data_buffer_memory;
+
+/*
+	Spawned particles wait on host for the next frame.
+	Persistent particles never die: initial and spawned ones.
+*/
+static ParticleStates _spawned_particles;
+static uint32_t _spawn_buffer_capacity;
+static uint32_t _persistent_particles_count;
+
+static FrameConstants _frame_constants;
+static PhysicsConstants _physics_constants;
+static uint32_t _physics_steps_count;
+static uint32_t _physics_emit_count;
+static uint32_t _physics_spawn_count;
+static uint32_t _physics_added_slots_count;
+static double _physics_time;
+static double _physics_time_accumulator;
+static double _physics_emission_accumulator;
 static Particles _particles;
 
+/*
+	Entry of render_frames the frame being drawn fills, NULL outside of it.
+*/
+static FrameTimings *_frame_timings;
+
 static char _vk_result_message[256];
 
 /* Helper functions */
@@ -219,7 +425,10 @@ static bool _begin_one_time_command()
 		&beginInfo
 	) == VK_SUCCESS;
 }
-static bool _submit_one_time_command()
+/*
+	Any queue of the graphics family, _operation_queue_families.use_same_family == true.
+*/
+static bool _submit_one_time_command_to_queue(VkQueue queue)
 {
 	vkEndCommandBuffer(
 		_command_buffers.data[_one_time_command_buffer_idx]
@@ -232,11 +441,15 @@ static bool _submit_one_time_command()
 	};
 
 	return (
-		vkQueueSubmit(_present_queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS &&
-		vkQueueWaitIdle(_present_queue) == VK_SUCCESS
+		vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS &&
+		vkQueueWaitIdle(queue) == VK_SUCCESS
 	);
 }
-static bool _create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage *image, VkDeviceMemory *image_memory, VkImageLayout layout)
+static bool _submit_one_time_command()
+{
+	return _submit_one_time_command_to_queue(_present_queue);
+}
+static bool _create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage *image, DeviceMemoryAllocation *image_memory, VkImageLayout layout)
 {
 	VkImageCreateInfo imageInfo = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -247,7 +460,7 @@ static bool _create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFla
 		.mipLevels = 1,
 		.arrayLayers = 1,
 		.format = format,
-		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.tiling = tiling,
 		.initialLayout = layout,
 		.usage = usage,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
@@ -259,27 +472,16 @@ static bool _create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFla
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(_device, *image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = memRequirements.size,
-	};
-
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(_physical_device, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-	{
-		if (
-			memRequirements.memoryTypeBits & (1 << i) &&
-			(memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		) {
-			allocInfo.memoryTypeIndex = i;
-		}
-	}
-
-	PROCESS_VK_RESULT(vkAllocateMemory(_device, &allocInfo, NULL, image_memory));
+	PROCESS_RESULT(
+		allocate_device_memory(
+			&memRequirements,
+			properties,
+			tiling == VK_IMAGE_TILING_LINEAR,
+			image_memory
+		)
+	);
 
-	return vkBindImageMemory(_device, *image, *image_memory, 0) == VK_SUCCESS;
+	return vkBindImageMemory(_device, *image, image_memory->memory, image_memory->offset) == VK_SUCCESS;
 }
 static bool _create_image_view(const VkImage *image, VkImageView *imageView, VkFormat format, VkImageAspectFlags aspectFlags) {
 	VkImageViewCreateInfo viewInfo = {
@@ -296,54 +498,20 @@ static bool _create_image_view(const VkImage *image, VkImageView *imageView, VkF
 
 	return vkCreateImageView(_device, &viewInfo, NULL, imageView) == VK_SUCCESS;
 }
-static bool _find_memory_type(uint32_t *memory_type, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(_physical_device, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if (
-			typeFilter & (1 << i) &&
-			(memProperties.memoryTypes[i].propertyFlags & properties) == properties
-		) {
-			*memory_type = i;
-
-			return true;
-		}
-	}
-
-	return false;
-}
-/*
-	Copy buffer from host visible GPU memory to faster GPU memory.
-	Command is written to _one_time_command_buffer (present queue).
-	Host waits for device present queue to get idle after execution.
-*/
-static bool _copy_buffer(VkBuffer *dst_buffer, VkBuffer *src_buffer, VkDeviceSize size)
-{
-	PROCESS_RESULT(_begin_one_time_command());
-
-	VkBufferCopy copy_attrs = { .size = size };
-
-	vkCmdCopyBuffer(
-		_command_buffers.data[_one_time_command_buffer_idx],
-		*src_buffer,
-		*dst_buffer,
-		1, &copy_attrs
-	);
-
-	return _submit_one_time_command();
-}
 
 /* Secondary logic */
 
 static void _setup_required_extensions()
 {
-	const char **glfw_names;
+	const char **glfw_names = NULL;
 
-	uint32_t glfw_count;
+	uint32_t glfw_count = 0;
 	uint32_t total_count;
 
-	glfw_names = glfwGetRequiredInstanceExtensions(&glfw_count);
+	if (!_render_settings.headless.enabled)
+	{
+		glfw_names = glfwGetRequiredInstanceExtensions(&glfw_count);
+	}
 
 	total_count = glfw_count;
 
@@ -443,15 +611,16 @@ static void _pick_swap_chain_surface_format(VkSurfaceFormatKHR *picked_surface_f
 }
 static void _pick_swap_chain_present_mode(VkPresentModeKHR *present_mode)
 {
-#ifdef NDEBUG
+	/*
+		FIFO is the only mode every surface supports.
+	*/
+	*present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
 	for (uint32_t i = 0; i < _present_modes.count; i += 1) {
-		if (_present_modes.data[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (_present_modes.data[i] == _render_settings.present_mode) {
 			*present_mode = _present_modes.data[i];
 		}
 	}
-#endif
-
-	*present_mode = VK_PRESENT_MODE_FIFO_KHR;
 }
 
 static bool _instance_supports_required_extensions()
@@ -508,6 +677,7 @@ static bool _set_queue_family_properties(const VkPhysicalDevice *physical_device
 			queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT
 		) {
 			_operation_queue_families.graphics_family_idx = (int)i;
+			_operation_queue_families.graphics_queue_count = queue_families[i].queueCount;
 		}
 
 		if (
@@ -517,9 +687,19 @@ static bool _set_queue_family_properties(const VkPhysicalDevice *physical_device
 			_operation_queue_families.compute_family_idx = (int)i;
 		}
 
-		VkBool32 present_support;
+		VkBool32 present_support = VK_FALSE;
 
-		vkGetPhysicalDeviceSurfaceSupportKHR(*physical_device, i, _surface, &present_support);
+		if (_render_settings.headless.enabled)
+		{
+			/*
+				Nothing is presented, the graphics family takes the present queue.
+			*/
+			present_support = (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(*physical_device, i, _surface, &present_support);
+		}
 
 		if (queue_families[i].queueCount > 0 && present_support)
 		{
@@ -542,6 +722,27 @@ static bool _set_queue_family_properties(const VkPhysicalDevice *physical_device
 		}
 	}
 
+	/*
+		Families with transfer but without graphics and compute
+		support are usually backed by dedicated copy engines.
+	*/
+	_operation_queue_families.transfer_family_idx = _operation_queue_families.compute_family_idx;
+
+	for (uint32_t i = 0; i < queue_families_num; i += 1)
+	{
+		VkQueueFlags flags = queue_families[i].queueFlags;
+
+		if (
+			queue_families[i].queueCount > 0 &&
+			flags & VK_QUEUE_TRANSFER_BIT &&
+			!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+		) {
+			_operation_queue_families.transfer_family_idx = (int)i;
+
+			break;
+		}
+	}
+
 	free(queue_families);
 
 	return result;
@@ -558,6 +759,14 @@ static bool _physical_device_suitable(const VkPhysicalDevice* physical_device)
 
 	bool extensions_supported = _physical_device_supports_required_extensions(physical_device);
 
+	/*
+		Software implementations report a CPU device.
+	*/
+	if (_render_settings.headless.enabled)
+	{
+		return _operation_queue_families.use_same_family && extensions_supported;
+	}
+
 	_set_surface_properties(physical_device);
 
 	bool surface_output_supported = (
@@ -572,33 +781,31 @@ static bool _physical_device_suitable(const VkPhysicalDevice* physical_device)
 		surface_output_supported
 	);
 }
-static bool _create_shader_module(VkShaderModule *shader_module, const char bin_shader_file_path[], char* shader_code)
+/*
+	Modules are created straight from the SPIR-V linked into the executable,
+	no file is read and the working directory does not matter.
+*/
+static bool _create_shader_module(VkShaderModule *shader_module, const char shader_name[])
 {
-	FILE *file_descriptor = fopen(bin_shader_file_path, "rb");
-
-	if (!file_descriptor)
+	for (uint32_t i = 0; i < embedded_shaders_count; i += 1)
 	{
-		return false;
-	}
-
-	fseek(file_descriptor, 0L, SEEK_END);
-	uint32_t code_size = ftell(file_descriptor);
-
-	rewind(file_descriptor);
-
-	shader_code = malloc(code_size);
+		const EmbeddedShader *shader = embedded_shaders + i;
 
-	fread(shader_code, code_size, 1, file_descriptor);
+		if (strcmp(shader->name, shader_name) == 0)
+		{
+			VkShaderModuleCreateInfo create_info = {
+				.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+				.codeSize = shader->code_size,
+				.pCode = shader->code,
+			};
 
-	VkShaderModuleCreateInfo create_info = {
-		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = code_size,
-		.pCode = (const uint32_t *)shader_code,
-	};
+			return vkCreateShaderModule(_device, &create_info, NULL, shader_module) == VK_SUCCESS;
+		}
+	}
 
-	return vkCreateShaderModule(_device, &create_info, NULL, shader_module) == VK_SUCCESS;
+	return false;
 }
-static bool _create_memory_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *buffer_memory)
+static bool _create_memory_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer, DeviceMemoryAllocation *buffer_memory)
 {
 	VkBufferCreateInfo bufferInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -612,15 +819,16 @@ static bool _create_memory_buffer(VkDeviceSize size, VkBufferUsageFlags usage, V
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(_device, *buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = memRequirements.size,
-	};
+	PROCESS_RESULT(allocate_device_memory(&memRequirements, properties, true, buffer_memory));
 
-	PROCESS_RESULT(_find_memory_type(&(allocInfo.memoryTypeIndex), memRequirements.memoryTypeBits, properties));
-	PROCESS_VK_RESULT(vkAllocateMemory(_device, &allocInfo, NULL, buffer_memory))
+	return vkBindBufferMemory(_device, *buffer, buffer_memory->memory, buffer_memory->offset) == VK_SUCCESS;
+}
+static void _destroy_memory_buffer(VkBuffer *buffer, DeviceMemoryAllocation *buffer_memory)
+{
+	vkDestroyBuffer(_device, *buffer, NULL);
+	free_device_memory(buffer_memory);
 
-	return vkBindBufferMemory(_device, *buffer, *buffer_memory, 0) == VK_SUCCESS;
+	*buffer = VK_NULL_HANDLE;
 }
 static bool _pick_depth_buffer_format()
 {
@@ -715,7 +923,7 @@ static bool _create_instance()
 		.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
 		.pEngineName = "zEngine",
 		.engineVersion = VK_MAKE_VERSION(1, 0, 0),
-		.apiVersion = VK_API_VERSION_1_0
+		.apiVersion = VK_API_VERSION_1_1
 	};
 
 	VkInstanceCreateInfo create_info = {
@@ -773,20 +981,38 @@ static bool _create_logical_device()
 {
 	float queuePriorities[DEVICE_QUEUES_COUNT] = { 1.0f, 0.5f, 0.0f };
 
-	VkDeviceQueueCreateInfo queue_create_info = {
-		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // all queues in this family
-		.queueCount = DEVICE_QUEUES_COUNT,
-		.pQueuePriorities = queuePriorities,
+	uint32_t queue_count = (
+		_operation_queue_families.graphics_queue_count < DEVICE_QUEUES_COUNT ?
+		_operation_queue_families.graphics_queue_count :
+		DEVICE_QUEUES_COUNT
+	);
+
+	float transfer_queue_priority = 0.5f;
+
+	VkDeviceQueueCreateInfo queue_create_infos[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // all queues in this family
+			.queueCount = queue_count,
+			.pQueuePriorities = queuePriorities,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = _operation_queue_families.transfer_family_idx,
+			.queueCount = 1,
+			.pQueuePriorities = &transfer_queue_priority,
+		},
 	};
 
+	bool dedicated_transfer_family = _operation_queue_families.transfer_family_idx != _operation_queue_families.graphics_family_idx;
+
 	VkPhysicalDeviceFeatures device_features;
 	vkGetPhysicalDeviceFeatures(_physical_device, &device_features);
 
 	VkDeviceCreateInfo create_info = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.pQueueCreateInfos = &queue_create_info,
-		.queueCreateInfoCount = 1,
+		.pQueueCreateInfos = queue_create_infos,
+		.queueCreateInfoCount = dedicated_transfer_family ? 2 : 1,
 		.pEnabledFeatures = &device_features,
 		.enabledExtensionCount = _required_physical_device_extensions.count,
 		.ppEnabledExtensionNames = _required_physical_device_extensions.names,
@@ -795,12 +1021,51 @@ static bool _create_logical_device()
 	PROCESS_VK_RESULT(vkCreateDevice(_physical_device, &create_info, NULL, &_device));
 
 	vkGetDeviceQueue(_device, _operation_queue_families.compute_family_idx, 0, &_compute_queue);
-	vkGetDeviceQueue(_device, _operation_queue_families.graphics_family_idx, 1, &_graphics_queue);
-	vkGetDeviceQueue(_device, _operation_queue_families.present_family_idx, 2, &_present_queue);
+	vkGetDeviceQueue(_device, _operation_queue_families.graphics_family_idx, 1 < queue_count ? 1 : queue_count - 1, &_graphics_queue);
+	vkGetDeviceQueue(_device, _operation_queue_families.present_family_idx, 2 < queue_count ? 2 : queue_count - 1, &_present_queue);
+
+	if (dedicated_transfer_family)
+	{
+		vkGetDeviceQueue(_device, _operation_queue_families.transfer_family_idx, 0, &_transfer_queue);
+	}
+	else
+	{
+		_transfer_queue = _compute_queue;
+	}
 
 	return true;
 }
-static bool _create_swap_chain()
+/*
+	Surfaces reporting no current extent take the framebuffer size of the window.
+	Minimized windows get a zero extent, no swap chain can be created for it.
+*/
+static void _pick_swap_chain_image_extent()
+{
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_physical_device, _surface, &_surface_capabilities);
+
+	if (_surface_capabilities.currentExtent.width != UINT32_MAX)
+	{
+		_swap_chain_image_extent = _surface_capabilities.currentExtent;
+
+		return;
+	}
+
+	int width, height;
+	glfwGetFramebufferSize(_window, &width, &height);
+
+	VkExtent2D min_extent = _surface_capabilities.minImageExtent;
+	VkExtent2D max_extent = _surface_capabilities.maxImageExtent;
+
+	_swap_chain_image_extent.width = (uint32_t)width < min_extent.width ? min_extent.width : (uint32_t)width;
+	_swap_chain_image_extent.width = _swap_chain_image_extent.width > max_extent.width ? max_extent.width : _swap_chain_image_extent.width;
+	_swap_chain_image_extent.height = (uint32_t)height < min_extent.height ? min_extent.height : (uint32_t)height;
+	_swap_chain_image_extent.height = _swap_chain_image_extent.height > max_extent.height ? max_extent.height : _swap_chain_image_extent.height;
+}
+/*
+	Old swap chain hands its presentation over to the new one,
+	VK_NULL_HANDLE when there is none.
+*/
+static bool _create_swap_chain(VkSwapchainKHR old_swap_chain)
 {
 	VkSurfaceFormatKHR picked_surface_format;
 	_pick_swap_chain_surface_format(&picked_surface_format);
@@ -808,9 +1073,6 @@ static bool _create_swap_chain()
 	VkPresentModeKHR picked_present_mode;
 	_pick_swap_chain_present_mode(&picked_present_mode);
 
-	_swap_chain_image_extent.width = _DEFAULT_WINDOW_WIDTH;
-	_swap_chain_image_extent.height = _DEFAULT_WINDOW_HEIGHT;
-
 	VkSwapchainCreateInfoKHR createInfo = {
 		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		.surface = _surface,
@@ -825,6 +1087,7 @@ static bool _create_swap_chain()
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 		.presentMode = picked_present_mode,
 		.clipped = VK_TRUE,
+		.oldSwapchain = old_swap_chain,
 	};
 
 	PROCESS_VK_RESULT(vkCreateSwapchainKHR(_device, &createInfo, NULL, &(_swap_chain)));
@@ -857,6 +1120,42 @@ static bool _create_swap_chain()
 	return true;
 
 }
+/*
+	Headless counterpart of the swap chain, one image of the configured size
+	which frames render into one after another. It can be copied out.
+*/
+static bool _create_offscreen_image()
+{
+	_swap_chain_image_extent.width = _render_settings.headless.width;
+	_swap_chain_image_extent.height = _render_settings.headless.height;
+	_swap_chain_image_format = OFFSCREEN_IMAGE_FORMAT;
+
+	PROCESS_RESULT(
+		_create_image(
+			_swap_chain_image_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&_offscreen_image,
+			&_offscreen_image_memory,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		)
+	);
+
+	_swap_chain_images.count = 1;
+	_swap_chain_images.data = malloc(sizeof(VkImage));
+	_swap_chain_images.data[0] = _offscreen_image;
+
+	_swap_chain_image_views.count = 1;
+	_swap_chain_image_views.data = malloc(sizeof(VkImageView));
+
+	return _create_image_view(
+		&_offscreen_image,
+		_swap_chain_image_views.data,
+		_swap_chain_image_format,
+		VK_IMAGE_ASPECT_COLOR_BIT
+	);
+}
 static bool _create_render_pass()
 {
 	VkAttachmentDescription color_attachment = {
@@ -867,7 +1166,11 @@ static bool _create_render_pass()
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		.finalLayout = (
+			_render_settings.headless.enabled ?
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+		),
 	};
 
 	VkAttachmentReference color_attachment_ref = {
@@ -898,13 +1201,20 @@ static bool _create_render_pass()
 		.pDepthStencilAttachment = &depth_attachment_ref,
 	};
 
+	/*
+		Headless frames share one color image, nothing but this dependency
+		orders its clear after the writes of the previous frame.
+	*/
 	VkSubpassDependency dependency = {
 		.srcSubpass = VK_SUBPASS_EXTERNAL,
 		.dstSubpass = 0,
-		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		.srcAccessMask = 0,
-		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.dstAccessMask = (
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+		),
 	};
 
 	VkAttachmentDescription attachments[2] = { color_attachment, depth_attachment };
@@ -921,16 +1231,76 @@ static bool _create_render_pass()
 
 	return vkCreateRenderPass(_device, &render_pass_info, NULL, &_render_pass) == VK_SUCCESS;
 }
+static bool _uses_compact_format()
+{
+	return _render_settings.particle_format != PARTICLE_FORMAT_FLOAT;
+}
+static VkDeviceSize _get_particle_stride()
+{
+	return _uses_compact_format() ? sizeof(CompactParticle) : sizeof(Particle);
+}
+static VkDeviceSize _get_vertex_stride()
+{
+	return _uses_compact_format() ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+/*
+	Vertex input formats of the compact layouts are among the ones
+	every Vulkan device supports for vertex buffers.
+*/
+static VkFormat _get_particle_position_format()
+{
+	switch (_render_settings.particle_format)
+	{
+		case PARTICLE_FORMAT_HALF: return VK_FORMAT_R16G16B16A16_SFLOAT;
+		case PARTICLE_FORMAT_UNORM16: return VK_FORMAT_R16G16B16A16_UNORM;
+		default: return VK_FORMAT_R32G32B32A32_SFLOAT;
+	}
+}
+static VkFormat _get_particle_color_format()
+{
+	return _uses_compact_format() ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+}
 static bool _create_graphics_pipeline()
 {
-	PROCESS_RESULT(_create_shader_module(&_vertex_shader, "vertex.spv", _vertex_shader_code));
-	PROCESS_RESULT(_create_shader_module(&_fragment_shader, "fragment.spv", _fragment_shader_code));
+	const char *vertex_shader_name = "vertex.spv";
+
+	if (_render_settings.render_path == RENDER_PATH_VERTEX_PULLING)
+	{
+		vertex_shader_name = "vertex_pulling.spv";
+	}
+	else if (_render_settings.render_path == RENDER_PATH_INSTANCED)
+	{
+		vertex_shader_name = "vertex_instanced.spv";
+	}
+
+	PROCESS_RESULT(_create_shader_module(&_vertex_shader, vertex_shader_name));
+	PROCESS_RESULT(_create_shader_module(&_fragment_shader, "fragment.spv"));
+
+	/*
+		Pulling vertex shader decodes particles of the format
+		from specialization constant 1, the others ignore it.
+	*/
+	VkSpecializationMapEntry particle_format_entry = {
+		.constantID = 1,
+		.offset = 0,
+		.size = sizeof(uint32_t),
+	};
+
+	uint32_t particle_format = (uint32_t)_render_settings.particle_format;
+
+	VkSpecializationInfo specialization_info = {
+		.mapEntryCount = 1,
+		.pMapEntries = &particle_format_entry,
+		.dataSize = sizeof(uint32_t),
+		.pData = &particle_format,
+	};
 
 	VkPipelineShaderStageCreateInfo vertex_shader_stage_ci = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 		.stage = VK_SHADER_STAGE_VERTEX_BIT,
 		.module = _vertex_shader,
 		.pName = "main",
+		.pSpecializationInfo = &specialization_info,
 	};
 
 	VkPipelineShaderStageCreateInfo fragment_shader_stage_ci = {
@@ -947,21 +1317,25 @@ static bool _create_graphics_pipeline()
 
 	VkVertexInputBindingDescription binding_description = {
 		.binding = 0,
-		.stride = sizeof(Vertex),
+		.stride = (uint32_t)_get_vertex_stride(),
 		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
 	};
 
+	/*
+		Expanded positions are in clip space, compact vertices
+		keep them as half floats whatever the particle format.
+	*/
 	VkVertexInputAttributeDescription attribute_descriptions[2];
 
 	attribute_descriptions[0].binding = 0;
 	attribute_descriptions[0].location = 0;
-	attribute_descriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attribute_descriptions[0].format = _uses_compact_format() ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
 	attribute_descriptions[0].offset = 0;
 
 	attribute_descriptions[1].binding = 0;
 	attribute_descriptions[1].location = 1;
-	attribute_descriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	attribute_descriptions[1].offset = sizeof(Vector4);
+	attribute_descriptions[1].format = _get_particle_color_format();
+	attribute_descriptions[1].offset = _uses_compact_format() ? offsetof(CompactVertex, color) : offsetof(Vertex, color);
 
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
@@ -972,45 +1346,86 @@ static bool _create_graphics_pipeline()
 		.pVertexAttributeDescriptions = attribute_descriptions,
 	};
 
+	/*
+		Instanced path: quad corners advance per vertex,
+		particles advance per instance.
+	*/
+	VkVertexInputBindingDescription instanced_binding_descriptions[2] = {
+		{
+			.binding = 0,
+			.stride = sizeof(Vector2),
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		},
+		{
+			.binding = 1,
+			.stride = (uint32_t)_get_particle_stride(),
+			.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+		},
+	};
+
+	VkVertexInputAttributeDescription instanced_attribute_descriptions[3] = {
+		{
+			.binding = 0,
+			.location = 0,
+			.format = VK_FORMAT_R32G32_SFLOAT,
+			.offset = 0,
+		},
+		{
+			.binding = 1,
+			.location = 1,
+			.format = _get_particle_position_format(),
+			.offset = 0,
+		},
+		{
+			.binding = 1,
+			.location = 2,
+			.format = _get_particle_color_format(),
+			.offset = _uses_compact_format() ? offsetof(CompactParticle, color) : offsetof(Particle, color),
+		},
+	};
+
 	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
 		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
 		.primitiveRestartEnable = VK_FALSE,
 	};
 
+	if (_render_settings.render_path == RENDER_PATH_VERTEX_PULLING)
+	{
+		/*
+			Pulling vertex shader has no vertex inputs at all.
+		*/
+		vertexInputInfo.vertexBindingDescriptionCount = 0;
+		vertexInputInfo.vertexAttributeDescriptionCount = 0;
+	}
+	else if (_render_settings.render_path == RENDER_PATH_INSTANCED)
+	{
+		vertexInputInfo.vertexBindingDescriptionCount = 2;
+		vertexInputInfo.vertexAttributeDescriptionCount = 3;
+		vertexInputInfo.pVertexBindingDescriptions = instanced_binding_descriptions;
+		vertexInputInfo.pVertexAttributeDescriptions = instanced_attribute_descriptions;
+
+		input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+	}
+
 	VkPipelineDepthStencilStateCreateInfo depthStencil = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 		.depthTestEnable = VK_TRUE,
-		.depthWriteEnable = VK_TRUE,
+		.depthWriteEnable = _render_settings.blend_particles ? VK_FALSE : VK_TRUE,
 		.depthCompareOp = VK_COMPARE_OP_LESS,
 		.stencilTestEnable = VK_FALSE,
 	};
 
-	VkViewport viewport = {
-		.x = 0.0f,
-		.y = 0.0f,
-		.width = (float)(_swap_chain_image_extent.width),
-		.height = (float)(_swap_chain_image_extent.height),
-		.minDepth = 0.0f,
-		.maxDepth = 1.0f,
-	};
-
-	VkOffset2D offset = {
-		.x = 0,
-		.y = 0,
-	};
-
-	VkRect2D scissor = {
-		.offset = offset,
-		.extent = _swap_chain_image_extent,
-	};
-
+	/*
+		Viewport and scissor are dynamic, set by the draw command buffers,
+		so the pipeline outlives swap chain recreation.
+	*/
 	VkPipelineViewportStateCreateInfo viewportState = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
 		.viewportCount = 1,
-		.pViewports = &viewport,
+		.pViewports = NULL,
 		.scissorCount = 1,
-		.pScissors = &scissor,
+		.pScissors = NULL,
 	};
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {
@@ -1044,12 +1459,15 @@ static bool _create_graphics_pipeline()
 			VK_COLOR_COMPONENT_B_BIT |
 			VK_COLOR_COMPONENT_A_BIT
 		),
-		.blendEnable = VK_FALSE,
+		/*
+			Blended particles come back to front from the depth sort.
+		*/
+		.blendEnable = _render_settings.blend_particles ? VK_TRUE : VK_FALSE,
 		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-		.dstColorBlendFactor = VK_BLEND_FACTOR_DST_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
 		.colorBlendOp = VK_BLEND_OP_ADD,
 		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
 		.alphaBlendOp = VK_BLEND_OP_ADD,
 	};
 
@@ -1067,7 +1485,7 @@ static bool _create_graphics_pipeline()
 
 	VkDynamicState dynamicStates[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicState = {
@@ -1076,12 +1494,18 @@ static bool _create_graphics_pipeline()
 		.pDynamicStates = dynamicStates,
 	};
 
+	VkPushConstantRange frame_constants_range = {
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.offset = 0,
+		.size = sizeof(FrameConstants),
+	};
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.setLayoutCount = 1,
 		.pSetLayouts = &_descriptor_set_layout,
-		.pushConstantRangeCount = 0, // Optional
-		.pPushConstantRanges = 0, // Optional
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &frame_constants_range,
 	};
 
 	PROCESS_VK_RESULT(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, NULL, &_graphics_pipeline_layout));
@@ -1096,6 +1520,7 @@ static bool _create_graphics_pipeline()
 		.pRasterizationState = &rasterizer,
 		.pMultisampleState = &multisampling,
 		.pColorBlendState = &colorBlending,
+		.pDynamicState = &dynamicState,
 		.layout = _graphics_pipeline_layout,
 		.renderPass = _render_pass,
 		.subpass = 0,
@@ -1103,703 +1528,3349 @@ static bool _create_graphics_pipeline()
 		.pDepthStencilState = &depthStencil,
 	};
 
-	return vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &_graphics_pipeline) == VK_SUCCESS;
+	return vkCreateGraphicsPipelines(_device, get_pipeline_cache(), 1, &pipelineInfo, NULL, &_graphics_pipeline) == VK_SUCCESS;
 }
-static bool _create_compute_pipeline()
+static bool _create_compute_pipeline_variant(VkShaderModule shader, VkPipelineLayout layout, uint32_t workgroup_size, VkPipeline *pipeline)
 {
-	PROCESS_RESULT(_create_shader_module(&_compute_shader, "compute.spv", _compute_shader_code));
+	/*
+		Compute shaders take local_size_x from specialization constant 0,
+		shaders reading or writing visible particles take their format from 1.
+	*/
+	VkSpecializationMapEntry map_entries[2] = {
+		{
+			.constantID = 0,
+			.offset = 0,
+			.size = sizeof(uint32_t),
+		},
+		{
+			.constantID = 1,
+			.offset = sizeof(uint32_t),
+			.size = sizeof(uint32_t),
+		},
+	};
+
+	uint32_t constants[2] = {
+		workgroup_size,
+		(uint32_t)_render_settings.particle_format,
+	};
+
+	VkSpecializationInfo specialization_info = {
+		.mapEntryCount = 2,
+		.pMapEntries = map_entries,
+		.dataSize = sizeof(constants),
+		.pData = constants,
+	};
 
 	VkPipelineShaderStageCreateInfo compute_shader_stage_ci = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-		.module = _compute_shader,
+		.module = shader,
 		.pName = "main",
+		.pSpecializationInfo = &specialization_info,
 	};
 
-	VkPipelineLayoutCreateInfo pipeline_layout_ci = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.pNext = NULL,
-		.setLayoutCount = 1,
-		.pSetLayouts = &_descriptor_set_layout,
-	};
-
-	PROCESS_VK_RESULT(vkCreatePipelineLayout(_device, &pipeline_layout_ci, NULL, &_compute_pipeline_layout));
-
 	VkComputePipelineCreateInfo pipeline_ci = {
 		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-		.layout = _compute_pipeline_layout,
+		.layout = layout,
 		.flags = 0,
 		.stage = compute_shader_stage_ci,
 	};
 
-	return vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_ci, NULL, &_compute_pipeline) == VK_SUCCESS;
+	return vkCreateComputePipelines(_device, get_pipeline_cache(), 1, &pipeline_ci, NULL, pipeline) == VK_SUCCESS;
 }
-static bool _create_depth_resources()
+static void _destroy_compute_tuning_workload(ComputeTuningWorkload *workload)
 {
-	PROCESS_RESULT(_pick_depth_buffer_format());
+	VkBuffer *buffers[8] = {
+		workload->position_buffers + 0, workload->position_buffers + 1,
+		workload->velocity_buffers + 0, workload->velocity_buffers + 1,
+		workload->alive_list_buffers + 0, workload->alive_list_buffers + 1,
+		&(workload->dead_list_buffer), &(workload->counters_buffer),
+	};
+
+	DeviceMemoryAllocation *buffers_memory[8] = {
+		workload->position_buffers_memory + 0, workload->position_buffers_memory + 1,
+		workload->velocity_buffers_memory + 0, workload->velocity_buffers_memory + 1,
+		workload->alive_list_buffers_memory + 0, workload->alive_list_buffers_memory + 1,
+		&(workload->dead_list_buffer_memory), &(workload->counters_buffer_memory),
+	};
+
+	for (uint32_t i = 0; i < 8; i += 1)
+	{
+		if (*(buffers[i]) != VK_NULL_HANDLE)
+		{
+			_destroy_memory_buffer(buffers[i], buffers_memory[i]);
+		}
+	}
+
+	if (workload->descriptor_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(_device, workload->descriptor_pool, NULL);
+
+		workload->descriptor_pool = VK_NULL_HANDLE;
+	}
+}
+/*
+	COMPUTE_TUNING_PARTICLE_COUNT particles, all alive with every velocity
+	component and the life time set to 1, independent of the scene being set up. Tuning on
+	the scene would time a handful of live particles, the winner would be
+	launch overhead noise cached for every later workload.
+	Recorded and submitted on the one time command queue only.
+*/
+static bool _create_compute_tuning_workload(ComputeTuningWorkload *workload)
+{
+	uint32_t count = COMPUTE_TUNING_PARTICLE_COUNT;
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	memset(workload, 0, sizeof(*workload));
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(Vector4) * count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				workload->position_buffers + i, workload->position_buffers_memory + i
+			)
+		);
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(Vector4) * count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				workload->velocity_buffers + i, workload->velocity_buffers_memory + i
+			)
+		);
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(uint32_t) * (1 + count), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				workload->alive_list_buffers + i, workload->alive_list_buffers_memory + i
+			)
+		);
+	}
+
 	PROCESS_RESULT(
-		_create_image(
-			_depth_image_format,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&_depth_image,
-			&_depth_image_memory,
-			VK_IMAGE_LAYOUT_UNDEFINED
+		_create_memory_buffer(
+			sizeof(uint32_t) * count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&(workload->dead_list_buffer), &(workload->dead_list_buffer_memory)
 		)
 	);
-	
 	PROCESS_RESULT(
-		_create_image_view(
-			&_depth_image,
-			&_depth_image_view,
-			_depth_image_format,
-			VK_IMAGE_ASPECT_DEPTH_BIT
+		_create_memory_buffer(
+			sizeof(ParticleCounters), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&(workload->counters_buffer), &(workload->counters_buffer_memory)
 		)
 	);
 
-	PROCESS_RESULT(_begin_one_time_command());
+	VkDescriptorPoolSize storage_buffer_size = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = PHYSICS_DATA_BINDINGS_COUNT,
+	};
+
+	VkDescriptorPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.poolSizeCount = 1,
+		.pPoolSizes = &storage_buffer_size,
+		.maxSets = 1,
+	};
+
+	PROCESS_VK_RESULT(vkCreateDescriptorPool(_device, &pool_info, NULL, &(workload->descriptor_pool)));
+
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = workload->descriptor_pool,
+		.pSetLayouts = &_physics_descriptor_set_layout,
+		.descriptorSetCount = 1,
+	};
 
-	VkImageMemoryBarrier barrier = {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = _depth_image,
-		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, &(workload->descriptor_set)));
+
+	/*
+		Bindings of the physics pass only, the frame particles, arguments,
+		spawned particles and colors are never read by it.
+	*/
+	uint32_t bindings[8] = { 0, 1, 3, 4, 5, 6, 9, 10 };
+
+	VkDescriptorBufferInfo buffer_infos[8] = {
+		{ .buffer = workload->position_buffers[0], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->position_buffers[1], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->alive_list_buffers[0], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->alive_list_buffers[1], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->dead_list_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->counters_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->velocity_buffers[0], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = workload->velocity_buffers[1], .offset = 0, .range = VK_WHOLE_SIZE },
 	};
 
-	if (
-		_depth_image_format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
-		_depth_image_format == VK_FORMAT_D24_UNORM_S8_UINT
-	) {
-		barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	VkWriteDescriptorSet write_descriptor_sets[8];
+
+	for (uint32_t i = 0; i < 8; i += 1)
+	{
+		VkWriteDescriptorSet write_descriptor_set = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workload->descriptor_set,
+			.dstBinding = bindings[i],
+			.dstArrayElement = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.pBufferInfo = buffer_infos + i,
+		};
+
+		write_descriptor_sets[i] = write_descriptor_set;
 	}
 
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0;
-	barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	vkUpdateDescriptorSets(_device, 8, write_descriptor_sets, 0, NULL);
 
-	vkCmdPipelineBarrier(
-		_command_buffers.data[_one_time_command_buffer_idx],
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		0, 0, NULL, 0, NULL, 1, &barrier
+	/*
+		Alive list holds every slot in order, staged through host visible memory.
+	*/
+	VkBuffer staging_buffer;
+	DeviceMemoryAllocation staging_buffer_memory;
+
+	PROCESS_RESULT(
+		_create_memory_buffer(
+			sizeof(uint32_t) * (1 + count),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&staging_buffer,
+			&staging_buffer_memory
+		)
 	);
 
-	return _submit_one_time_command();
-}
-static bool _create_descriptor_pool()
-{
-	VkDescriptorPoolSize uniform_buffer_size = {
-		.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = 1,
-	};
+	uint32_t *alive_list = (uint32_t *)staging_buffer_memory.mapped;
 
-	VkDescriptorPoolSize storage_buffer_size = {
-		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 3,
-	};
+	alive_list[0] = count;
 
-	VkDescriptorPoolSize pool_sizes[] = {
-		uniform_buffer_size,
-		storage_buffer_size
-	};
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		alive_list[1 + i] = i;
+	}
 
-	VkDescriptorPoolCreateInfo pool_info = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.poolSizeCount = 2,
-		.pPoolSizes = pool_sizes,
-		.maxSets = GPU_DATA_BINDINGS_COUNT,
+	VkCommandBuffer command_buffer = _command_buffers.data[_one_time_command_buffer_idx];
+
+	VkBufferCopy copy_region = {
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = sizeof(uint32_t) * (1 + count),
 	};
 
-	return vkCreateDescriptorPool(_device, &pool_info, NULL, &_descriptor_pool) == VK_SUCCESS;
+	bool result = _begin_one_time_command();
+
+	if (result)
+	{
+		/*
+			1.0f bit pattern in every component, velocity.w is the life time.
+			Zero length steps never move the particles nor age them.
+		*/
+		vkCmdFillBuffer(command_buffer, workload->position_buffers[0], 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(command_buffer, workload->velocity_buffers[0], 0, VK_WHOLE_SIZE, 0x3f800000);
+		vkCmdFillBuffer(command_buffer, workload->counters_buffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdCopyBuffer(command_buffer, staging_buffer, workload->alive_list_buffers[0], 1, &copy_region);
+
+		result = _submit_one_time_command();
+	}
+
+	_destroy_memory_buffer(&staging_buffer, &staging_buffer_memory);
+
+	return result;
 }
-static bool _create_descriptor_set_layout()
+/*
+	GPU time in nanoseconds of a few back to back physics dispatches over
+	the tuning workload, the best of several runs. Steps are zero length,
+	the input alive list is never consumed and every dispatch does the same work.
+*/
+static bool _measure_compute_pipeline_variant(VkPipeline pipeline, uint32_t workgroup_size, const ComputeTuningWorkload *workload, VkQueryPool query_pool, float timestamp_period, uint64_t timestamp_mask, double *time)
 {
-	VkDescriptorSetLayoutBinding verticies_layout_binding = {
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-		.binding = 0,
-		.descriptorCount = 1,
-	};
+	VkCommandBuffer command_buffer = _command_buffers.data[_one_time_command_buffer_idx];
 
-	VkDescriptorSetLayoutBinding indices_layout_binding = {
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-		.binding = 1,
-		.descriptorCount = 1,
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
 	};
 
-	VkDescriptorSetLayoutBinding uniform_data_layout_binding = {
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT,
-		.binding = 2,
-		.descriptorCount = 1,
-	};
+	uint32_t group_count = (COMPUTE_TUNING_PARTICLE_COUNT + workgroup_size - 1) / workgroup_size;
 
-	VkDescriptorSetLayoutBinding particles_layout_binding = {
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-		.binding = 3,
-		.descriptorCount = 1,
-	};
+	*time = 0.0;
 
-	VkDescriptorSetLayoutBinding bindings[GPU_DATA_BINDINGS_COUNT] = {
-		verticies_layout_binding,
-		indices_layout_binding,
-		uniform_data_layout_binding,
-		particles_layout_binding,
-	};
+	for (uint32_t run = 0; run < COMPUTE_TUNING_RUNS_COUNT; run += 1)
+	{
+		PROCESS_RESULT(_begin_one_time_command());
 
-	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.pNext = NULL,
-		.pBindings = bindings,
-		.bindingCount = GPU_DATA_BINDINGS_COUNT,
-	};
+		vkCmdResetQueryPool(command_buffer, query_pool, 0, 2);
 
-	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_descriptor_set_layout) == VK_SUCCESS;
+		PhysicsConstants physics_constants = _physics_constants;
+		physics_constants.time_step = 0.0f;
+		physics_constants.particle_capacity = COMPUTE_TUNING_PARTICLE_COUNT;
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			_physics_pipeline_layout, 0, 1, &(workload->descriptor_set), 0, NULL
+		);
+		vkCmdPushConstants(
+			command_buffer,
+			_physics_pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0, sizeof(PhysicsConstants), &physics_constants
+		);
+
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+
+		for (uint32_t i = 0; i < COMPUTE_TUNING_DISPATCHES_COUNT; i += 1)
+		{
+			/*
+				Step arguments normally empty the output alive list.
+			*/
+			vkCmdFillBuffer(command_buffer, workload->alive_list_buffers[1], 0, sizeof(uint32_t), 0);
+
+			vkCmdPipelineBarrier(
+				command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_FLAGS_NONE,
+				1, &memory_barrier, 0, NULL, 0, NULL
+			);
+
+			vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+			vkCmdPipelineBarrier(
+				command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_FLAGS_NONE,
+				1, &memory_barrier, 0, NULL, 0, NULL
+			);
+		}
+
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1);
+
+		PROCESS_RESULT(_submit_one_time_command());
+
+		uint64_t timestamps[2];
+
+		PROCESS_VK_RESULT(
+			vkGetQueryPoolResults(
+				_device, query_pool, 0, 2,
+				sizeof(timestamps), timestamps, sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+			)
+		);
+
+		double run_time = (double)((timestamps[1] - timestamps[0]) & timestamp_mask) * timestamp_period;
+
+		if (run == 0 || run_time < *time)
+		{
+			*time = run_time;
+		}
+	}
+
+	return true;
 }
-static bool _create_descriptor_sets()
+/*
+	Pick the fastest workgroup size among multiples of the subgroup size.
+	Result is cached on disk per device, tuning runs once per driver.
+*/
+static bool _tune_compute_workgroup_size()
 {
-	VkDescriptorSetAllocateInfo alloc_info = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.pNext = NULL,
-		.descriptorPool = _descriptor_pool,
-		.pSetLayouts = &_descriptor_set_layout,
-		.descriptorSetCount = 1,
+	VkPhysicalDeviceSubgroupProperties subgroup_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
 	};
 
-	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, &_descriptor_set));
-
-	VkDescriptorBufferInfo vertex_buffer_info = {
-		.buffer = _device_vertex_buffer,
-		.offset = 0,
-		.range = VK_WHOLE_SIZE,
+	VkPhysicalDeviceIDProperties id_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+		.pNext = &subgroup_properties,
 	};
 
-	VkDescriptorBufferInfo index_buffer_info = {
-		.buffer = _device_index_buffer,
-		.offset = 0,
-		.range = VK_WHOLE_SIZE,
+	VkPhysicalDeviceProperties2 device_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &id_properties,
 	};
 
-	VkDescriptorBufferInfo mvp_buffer_info = {
-		.buffer = _device_uniform_data_buffer,
-		.offset = 0,
-		.range = VK_WHOLE_SIZE,
-	};
+	vkGetPhysicalDeviceProperties2(_physical_device, &device_properties);
 
-	VkDescriptorBufferInfo particle_buffer_info = {
-		.buffer = _device_particle_buffer,
-		.offset = 0,
-		.range = VK_WHOLE_SIZE,
-	};
+	const VkPhysicalDeviceLimits *limits = &(device_properties.properties.limits);
+	uint32_t driver_version = device_properties.properties.driverVersion;
 
-	VkWriteDescriptorSet vertex_write_descriptor_set = {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet = _descriptor_set,
-		.dstBinding = 0,
-		.dstArrayElement = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 1,
-		.pBufferInfo = &vertex_buffer_info,
+	uint32_t max_workgroup_size = limits->maxComputeWorkGroupSize[0];
+
+	if (limits->maxComputeWorkGroupInvocations < max_workgroup_size)
+	{
+		max_workgroup_size = limits->maxComputeWorkGroupInvocations;
+	}
+
+	uint32_t subgroup_size = subgroup_properties.subgroupSize > 0 ? subgroup_properties.subgroupSize : DEFAULT_COMPUTE_WORKGROUP_SIZE;
+
+	if (subgroup_size > max_workgroup_size)
+	{
+		subgroup_size = max_workgroup_size;
+	}
+
+	_compute_workgroup_size = subgroup_size;
+
+	if (load_tuned_workgroup_size(id_properties.deviceUUID, driver_version, &_compute_workgroup_size))
+	{
+		if (_compute_workgroup_size <= max_workgroup_size)
+		{
+			return true;
+		}
+
+		_compute_workgroup_size = subgroup_size;
+	}
+
+	/*
+		Tuning runs on the one time command queue, timestamps wrap
+		past the valid bits of its family.
+	*/
+	uint32_t queue_families_num = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &queue_families_num, NULL);
+
+	VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_families_num);
+	vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &queue_families_num, queue_families);
+
+	uint32_t timestamp_valid_bits = queue_families[_operation_queue_families.present_family_idx].timestampValidBits;
+
+	free(queue_families);
+
+	if (!limits->timestampComputeAndGraphics || timestamp_valid_bits == 0)
+	{
+		return true;
+	}
+
+	uint64_t timestamp_mask = timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
+	VkQueryPoolCreateInfo query_pool_ci = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 2,
 	};
 
-	VkWriteDescriptorSet index_write_descriptor_set = {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet = _descriptor_set,
-		.dstBinding = 1,
-		.dstArrayElement = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 1,
-		.pBufferInfo = &index_buffer_info,
-	};
+	/*
+		Devices without room for the workload keep the subgroup size untuned.
+	*/
+	ComputeTuningWorkload workload;
+
+	if (!_create_compute_tuning_workload(&workload))
+	{
+		_destroy_compute_tuning_workload(&workload);
+
+		return true;
+	}
+
+	VkQueryPool query_pool;
+
+	if (vkCreateQueryPool(_device, &query_pool_ci, NULL, &query_pool) != VK_SUCCESS)
+	{
+		_destroy_compute_tuning_workload(&workload);
+
+		return false;
+	}
+
+	bool result = true;
+	double best_time = 0.0;
+
+	for (uint32_t i = 0; i < COMPUTE_TUNING_CANDIDATES_COUNT && result; i += 1)
+	{
+		uint32_t workgroup_size = subgroup_size << i;
+
+		if (workgroup_size > max_workgroup_size)
+		{
+			break;
+		}
+
+		VkPipeline pipeline;
+		double time;
+
+		result = _create_compute_pipeline_variant(_physics_shader, _physics_pipeline_layout, workgroup_size, &pipeline);
+
+		if (result)
+		{
+			result = _measure_compute_pipeline_variant(pipeline, workgroup_size, &workload, query_pool, limits->timestampPeriod, timestamp_mask, &time);
+
+			vkDestroyPipeline(_device, pipeline, NULL);
+		}
+
+		if (result && (i == 0 || time < best_time))
+		{
+			best_time = time;
+			_compute_workgroup_size = workgroup_size;
+		}
+	}
+
+	vkDestroyQueryPool(_device, query_pool, NULL);
+
+	_destroy_compute_tuning_workload(&workload);
+
+	if (result)
+	{
+		store_tuned_workgroup_size(id_properties.deviceUUID, driver_version, _compute_workgroup_size);
+	}
+
+	return result;
+}
+static bool _create_compute_pipeline()
+{
+	PROCESS_RESULT(_create_shader_module(&_compute_shader, "compute.spv"));
+
+	VkPushConstantRange frame_constants_range = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(FrameConstants),
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.setLayoutCount = 1,
+		.pSetLayouts = &_descriptor_set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &frame_constants_range,
+	};
+
+	PROCESS_VK_RESULT(vkCreatePipelineLayout(_device, &pipeline_layout_ci, NULL, &_compute_pipeline_layout));
+
+	return _create_compute_pipeline_variant(_compute_shader, _compute_pipeline_layout, _compute_workgroup_size, &_compute_pipeline);
+}
+/*
+	Grid scan passes run FLUID_GRID_SCAN_BLOCK_SIZE / 4 invocations per workgroup,
+	the rest run one invocation per alive particle.
+*/
+static bool _create_fluid_pipelines()
+{
+	PROCESS_RESULT(_create_shader_module(&_grid_count_shader, "compute_grid_count.spv"));
+	PROCESS_RESULT(_create_shader_module(&_grid_scan_shader, "compute_grid_scan.spv"));
+	PROCESS_RESULT(_create_shader_module(&_grid_scan_blocks_shader, "compute_grid_scan_blocks.spv"));
+	PROCESS_RESULT(_create_shader_module(&_grid_scan_add_shader, "compute_grid_scan_add.spv"));
+	PROCESS_RESULT(_create_shader_module(&_grid_scatter_shader, "compute_grid_scatter.spv"));
+	PROCESS_RESULT(_create_shader_module(&_sph_density_shader, "compute_sph_density.spv"));
+	PROCESS_RESULT(_create_shader_module(&_sph_forces_shader, "compute_sph_forces.spv"));
+
+	VkPipelineLayout layout = _physics_pipeline_layout;
+	uint32_t scan_workgroup_size = FLUID_GRID_SCAN_BLOCK_SIZE / 4;
+
+	return (
+		_create_compute_pipeline_variant(_grid_count_shader, layout, _compute_workgroup_size, &_grid_count_pipeline) &&
+		_create_compute_pipeline_variant(_grid_scan_shader, layout, scan_workgroup_size, &_grid_scan_pipeline) &&
+		_create_compute_pipeline_variant(_grid_scan_blocks_shader, layout, scan_workgroup_size, &_grid_scan_blocks_pipeline) &&
+		_create_compute_pipeline_variant(_grid_scan_add_shader, layout, scan_workgroup_size, &_grid_scan_add_pipeline) &&
+		_create_compute_pipeline_variant(_grid_scatter_shader, layout, _compute_workgroup_size, &_grid_scatter_pipeline) &&
+		_create_compute_pipeline_variant(_sph_density_shader, layout, _compute_workgroup_size, &_sph_density_pipeline) &&
+		_create_compute_pipeline_variant(_sph_forces_shader, layout, _compute_workgroup_size, &_sph_forces_pipeline)
+	);
+}
+/*
+	Morton code sort passes are the radix sort passes of blended particles
+	built for the physics layout, they run RADIX_SORT_WORKGROUP_SIZE invocations
+	per workgroup. Tree passes run one invocation per alive particle.
+*/
+static bool _create_gravity_tree_pipelines()
+{
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_arguments_shader, "compute_gravity_tree_arguments.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_bounds_shader, "compute_gravity_tree_bounds.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_morton_shader, "compute_gravity_tree_morton.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_radix_histogram_shader, "compute_radix_histogram_tree.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_radix_scan_shader, "compute_radix_scan_tree.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_radix_scatter_shader, "compute_radix_scatter_tree.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_build_shader, "compute_gravity_tree_build.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_summarize_shader, "compute_gravity_tree_summarize.spv"));
+	PROCESS_RESULT(_create_shader_module(&_gravity_tree_forces_shader, "compute_gravity_tree_forces.spv"));
+
+	VkPipelineLayout layout = _physics_pipeline_layout;
+
+	return (
+		_create_compute_pipeline_variant(_gravity_tree_arguments_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_gravity_tree_arguments_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_bounds_shader, layout, _compute_workgroup_size, &_gravity_tree_bounds_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_morton_shader, layout, _compute_workgroup_size, &_gravity_tree_morton_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_radix_histogram_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_gravity_tree_radix_histogram_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_radix_scan_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_gravity_tree_radix_scan_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_radix_scatter_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_gravity_tree_radix_scatter_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_build_shader, layout, _compute_workgroup_size, &_gravity_tree_build_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_summarize_shader, layout, _compute_workgroup_size, &_gravity_tree_summarize_pipeline) &&
+		_create_compute_pipeline_variant(_gravity_tree_forces_shader, layout, _compute_workgroup_size, &_gravity_tree_forces_pipeline)
+	);
+}
+/*
+	Physics runs on every render path, compute workgroup size is tuned on it.
+*/
+static bool _create_physics_pipeline()
+{
+	PROCESS_RESULT(_create_shader_module(&_physics_shader, "compute_physics.spv"));
+
+	VkPushConstantRange physics_constants_range = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PhysicsConstants),
+	};
+
+	VkDescriptorSetLayout set_layouts[4] = {
+		_physics_descriptor_set_layout,
+		_fluid_descriptor_set_layout,
+		_sort_descriptor_set_layout,
+		_gravity_tree_descriptor_set_layout,
+	};
+
+	uint32_t set_layouts_count = 1;
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+	{
+		set_layouts_count = 4;
+	}
+	else if (_render_settings.physics.fluid.enabled)
+	{
+		set_layouts_count = 2;
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.setLayoutCount = set_layouts_count,
+		.pSetLayouts = set_layouts,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &physics_constants_range,
+	};
+
+	PROCESS_VK_RESULT(vkCreatePipelineLayout(_device, &pipeline_layout_ci, NULL, &_physics_pipeline_layout));
+
+	PROCESS_RESULT(_tune_compute_workgroup_size());
+
+#ifdef _DEBUG
+	printf("Compute workgroup size: %u.\n", _compute_workgroup_size);
+#endif
+
+	PROCESS_RESULT(_create_shader_module(&_emit_shader, "compute_emit.spv"));
+	PROCESS_RESULT(_create_shader_module(&_step_arguments_shader, "compute_step_arguments.spv"));
+
+	/*
+		Workgroup size is tuned on plain physics, fluid physics
+		also integrates SPH accelerations.
+	*/
+	VkShaderModule physics_shader = _physics_shader;
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_DIRECT)
+	{
+		PROCESS_RESULT(_create_shader_module(&_gravity_direct_shader, "compute_gravity_direct.spv"));
+		PROCESS_RESULT(
+			_create_compute_pipeline_variant(
+				_gravity_direct_shader,
+				_physics_pipeline_layout,
+				_compute_workgroup_size,
+				&_gravity_direct_pipeline
+			)
+		);
+	}
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+	{
+		PROCESS_RESULT(_create_gravity_tree_pipelines());
+	}
+
+	if (_render_settings.physics.fluid.enabled)
+	{
+		PROCESS_RESULT(_create_shader_module(&_fluid_physics_shader, "compute_physics_fluid.spv"));
+		PROCESS_RESULT(_create_fluid_pipelines());
+
+		physics_shader = _fluid_physics_shader;
+	}
+
+	/*
+		Argument passes run a single invocation,
+		they take the workgroup size of the passes they size.
+	*/
+	return (
+		_create_compute_pipeline_variant(physics_shader, _physics_pipeline_layout, _compute_workgroup_size, &_physics_pipeline) &&
+		_create_compute_pipeline_variant(_emit_shader, _physics_pipeline_layout, _compute_workgroup_size, &_emit_pipeline) &&
+		_create_compute_pipeline_variant(_step_arguments_shader, _physics_pipeline_layout, _compute_workgroup_size, &_step_arguments_pipeline)
+	);
+}
+/*
+	Radix sort passes run RADIX_SORT_WORKGROUP_SIZE invocations per workgroup
+	whatever the tuned size is, gather runs one invocation per particle.
+*/
+static bool _create_sort_pipelines()
+{
+	PROCESS_RESULT(_create_shader_module(&_sort_arguments_shader, "compute_sort_arguments.spv"));
+	PROCESS_RESULT(_create_shader_module(&_radix_histogram_shader, "compute_radix_histogram.spv"));
+	PROCESS_RESULT(_create_shader_module(&_radix_scan_shader, "compute_radix_scan.spv"));
+	PROCESS_RESULT(_create_shader_module(&_radix_scatter_shader, "compute_radix_scatter.spv"));
+	PROCESS_RESULT(_create_shader_module(&_sort_gather_shader, "compute_sort_gather.spv"));
+
+	VkPipelineLayout layout = _frame_pass_pipeline_layout;
+
+	return (
+		_create_compute_pipeline_variant(_sort_arguments_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_sort_arguments_pipeline) &&
+		_create_compute_pipeline_variant(_radix_histogram_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_radix_histogram_pipeline) &&
+		_create_compute_pipeline_variant(_radix_scan_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_radix_scan_pipeline) &&
+		_create_compute_pipeline_variant(_radix_scatter_shader, layout, RADIX_SORT_WORKGROUP_SIZE, &_radix_scatter_pipeline) &&
+		_create_compute_pipeline_variant(_sort_gather_shader, layout, _compute_workgroup_size, &_sort_gather_pipeline)
+	);
+}
+/*
+	Culling tests particles against the view frustum of frame constants,
+	it runs on every render path after the physics steps.
+	Blended particles are culled into sort keys instead of particles.
+*/
+static bool _create_frame_pass_pipelines()
+{
+	const char *cull_shader_name = _render_settings.blend_particles ? "compute_cull_sorted.spv" : "compute_cull.spv";
+
+	PROCESS_RESULT(_create_shader_module(&_cull_shader, cull_shader_name));
+	PROCESS_RESULT(_create_shader_module(&_cull_arguments_shader, "compute_cull_arguments.spv"));
+	PROCESS_RESULT(_create_shader_module(&_draw_arguments_shader, "compute_draw_arguments.spv"));
+
+	VkPushConstantRange frame_pass_constants_range = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(FramePassConstants),
+	};
+
+	VkDescriptorSetLayout set_layouts[2] = {
+		_physics_descriptor_set_layout,
+		_sort_descriptor_set_layout,
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.setLayoutCount = _render_settings.blend_particles ? 2 : 1,
+		.pSetLayouts = set_layouts,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &frame_pass_constants_range,
+	};
+
+	PROCESS_VK_RESULT(vkCreatePipelineLayout(_device, &pipeline_layout_ci, NULL, &_frame_pass_pipeline_layout));
+
+	PROCESS_RESULT(
+		_create_compute_pipeline_variant(_cull_shader, _frame_pass_pipeline_layout, _compute_workgroup_size, &_cull_pipeline) &&
+		_create_compute_pipeline_variant(_cull_arguments_shader, _frame_pass_pipeline_layout, _compute_workgroup_size, &_cull_arguments_pipeline) &&
+		_create_compute_pipeline_variant(_draw_arguments_shader, _frame_pass_pipeline_layout, _compute_workgroup_size, &_draw_arguments_pipeline)
+	);
+
+	if (_render_settings.blend_particles)
+	{
+		PROCESS_RESULT(_create_sort_pipelines());
+	}
+
+	return true;
+}
+static bool _create_depth_resources()
+{
+	PROCESS_RESULT(_pick_depth_buffer_format());
+	PROCESS_RESULT(
+		_create_image(
+			_depth_image_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&_depth_image,
+			&_depth_image_memory,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		)
+	);
+	
+	/*
+		No layout transition is submitted, the render pass clears the depth
+		attachment from an undefined layout. Recreating it never waits for the queue.
+	*/
+	return _create_image_view(
+		&_depth_image,
+		&_depth_image_view,
+		_depth_image_format,
+		VK_IMAGE_ASPECT_DEPTH_BIT
+	);
+}
+static bool _create_descriptor_pool()
+{
+	VkDescriptorPoolSize storage_buffer_size = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = (
+			(GPU_DATA_BINDINGS_COUNT + 2 * PHYSICS_DATA_BINDINGS_COUNT) * _frames.count +
+			2 * SORT_DATA_BINDINGS_COUNT +
+			FLUID_DATA_BINDINGS_COUNT +
+			GRAVITY_TREE_DATA_BINDINGS_COUNT
+		),
+	};
+
+	VkDescriptorPoolSize pool_sizes[] = {
+		storage_buffer_size
+	};
+
+	VkDescriptorPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.poolSizeCount = 1,
+		.pPoolSizes = pool_sizes,
+		.maxSets = 3 * _frames.count + 4,  // render set and two physics sets per frame, two sort sets, fluid and gravity tree sets
+	};
+
+	return vkCreateDescriptorPool(_device, &pool_info, NULL, &_descriptor_pool) == VK_SUCCESS;
+}
+static bool _create_descriptor_set_layout()
+{
+	VkDescriptorSetLayoutBinding verticies_layout_binding = {
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		.binding = 0,
+		.descriptorCount = 1,
+	};
+
+	VkDescriptorSetLayoutBinding indices_layout_binding = {
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.binding = 1,
+		.descriptorCount = 1,
+	};
+
+	VkDescriptorSetLayoutBinding particles_layout_binding = {
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT,
+		.binding = 3,
+		.descriptorCount = 1,
+	};
+
+	VkDescriptorSetLayoutBinding arguments_layout_binding = {
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.binding = 2,
+		.descriptorCount = 1,
+	};
+
+	VkDescriptorSetLayoutBinding bindings[GPU_DATA_BINDINGS_COUNT] = {
+		verticies_layout_binding,
+		indices_layout_binding,
+		particles_layout_binding,
+		arguments_layout_binding,
+	};
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.pBindings = bindings,
+		.bindingCount = GPU_DATA_BINDINGS_COUNT,
+	};
+
+	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_descriptor_set_layout) == VK_SUCCESS;
+}
+static bool _create_physics_descriptor_set_layout()
+{
+	VkDescriptorSetLayoutBinding bindings[PHYSICS_DATA_BINDINGS_COUNT];
+
+	/*
+		State in, state out, particles of the frame, alive list in,
+		alive list out, dead list, counters, arguments of the frame,
+		spawned particles of the frame.
+	*/
+	for (uint32_t i = 0; i < PHYSICS_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkDescriptorSetLayoutBinding binding = {
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.binding = i,
+			.descriptorCount = 1,
+		};
+
+		bindings[i] = binding;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.pBindings = bindings,
+		.bindingCount = PHYSICS_DATA_BINDINGS_COUNT,
+	};
+
+	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_physics_descriptor_set_layout) == VK_SUCCESS;
+}
+static bool _create_sort_descriptor_set_layout()
+{
+	VkDescriptorSetLayoutBinding bindings[SORT_DATA_BINDINGS_COUNT];
+
+	/*
+		Keys in, values in, keys out, values out, histograms, sort arguments.
+	*/
+	for (uint32_t i = 0; i < SORT_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkDescriptorSetLayoutBinding binding = {
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.binding = i,
+			.descriptorCount = 1,
+		};
+
+		bindings[i] = binding;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.pBindings = bindings,
+		.bindingCount = SORT_DATA_BINDINGS_COUNT,
+	};
+
+	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_sort_descriptor_set_layout) == VK_SUCCESS;
+}
+static bool _create_fluid_descriptor_set_layout()
+{
+	VkDescriptorSetLayoutBinding bindings[FLUID_DATA_BINDINGS_COUNT];
+
+	/*
+		Parameters, grid entries, cell counts, cell starts, cell ends,
+		block sums, sorted particles, densities, accelerations.
+	*/
+	for (uint32_t i = 0; i < FLUID_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkDescriptorSetLayoutBinding binding = {
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.binding = i,
+			.descriptorCount = 1,
+		};
+
+		bindings[i] = binding;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.pBindings = bindings,
+		.bindingCount = FLUID_DATA_BINDINGS_COUNT,
+	};
+
+	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_fluid_descriptor_set_layout) == VK_SUCCESS;
+}
+static bool _create_gravity_tree_descriptor_set_layout()
+{
+	VkDescriptorSetLayoutBinding bindings[GRAVITY_TREE_DATA_BINDINGS_COUNT];
+
+	/*
+		Bounds, nodes, leaf parents, node data.
+	*/
+	for (uint32_t i = 0; i < GRAVITY_TREE_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkDescriptorSetLayoutBinding binding = {
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.binding = i,
+			.descriptorCount = 1,
+		};
+
+		bindings[i] = binding;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_ci = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.pBindings = bindings,
+		.bindingCount = GRAVITY_TREE_DATA_BINDINGS_COUNT,
+	};
+
+	return vkCreateDescriptorSetLayout(_device, &descriptor_set_layout_ci, NULL, &_gravity_tree_descriptor_set_layout) == VK_SUCCESS;
+}
+static bool _create_descriptor_set(FrameResources *frame)
+{
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = _descriptor_pool,
+		.pSetLayouts = &_descriptor_set_layout,
+		.descriptorSetCount = 1,
+	};
+
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, &(frame->descriptor_set)));
+
+	VkDescriptorBufferInfo vertex_buffer_info = {
+		.buffer = frame->vertex_buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+
+	VkDescriptorBufferInfo index_buffer_info = {
+		.buffer = frame->index_buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+
+	VkDescriptorBufferInfo particle_buffer_info = {
+		.buffer = frame->particle_buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+
+	VkWriteDescriptorSet vertex_write_descriptor_set = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = frame->descriptor_set,
+		.dstBinding = 0,
+		.dstArrayElement = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.pBufferInfo = &vertex_buffer_info,
+	};
+
+	VkWriteDescriptorSet index_write_descriptor_set = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = frame->descriptor_set,
+		.dstBinding = 1,
+		.dstArrayElement = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.pBufferInfo = &index_buffer_info,
+	};
+
+	VkWriteDescriptorSet particle_write_descriptor_set = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = frame->descriptor_set,
+		.dstBinding = 3,
+		.dstArrayElement = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.pBufferInfo = &particle_buffer_info,
+	};
+
+	VkDescriptorBufferInfo arguments_buffer_info = {
+		.buffer = frame->arguments_buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+
+	VkWriteDescriptorSet arguments_write_descriptor_set = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = frame->descriptor_set,
+		.dstBinding = 2,
+		.dstArrayElement = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.pBufferInfo = &arguments_buffer_info,
+	};
+
+	VkWriteDescriptorSet write_descriptor_sets[GPU_DATA_BINDINGS_COUNT] = {
+		vertex_write_descriptor_set,
+		index_write_descriptor_set,
+		particle_write_descriptor_set,
+		arguments_write_descriptor_set,
+	};
+
+	/*
+		Vertex and index buffers exist for compute expansion only.
+	*/
+	if (_render_settings.render_path == RENDER_PATH_COMPUTE_EXPANDED)
+	{
+		vkUpdateDescriptorSets(_device, GPU_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+	}
+	else
+	{
+		vkUpdateDescriptorSets(_device, GPU_DATA_BINDINGS_COUNT - 2, write_descriptor_sets + 2, 0, NULL);
+	}
+
+	return true;
+}
+static bool _create_physics_descriptor_sets(FrameResources *frame)
+{
+	VkDescriptorSetLayout set_layouts[2] = {
+		_physics_descriptor_set_layout,
+		_physics_descriptor_set_layout,
+	};
+
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = _descriptor_pool,
+		.pSetLayouts = set_layouts,
+		.descriptorSetCount = 2,
+	};
+
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, frame->physics_descriptor_sets));
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		VkDescriptorBufferInfo buffer_infos[PHYSICS_DATA_BINDINGS_COUNT] = {
+			{ .buffer = _particle_position_buffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _particle_position_buffers[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = frame->particle_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _alive_list_buffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _alive_list_buffers[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _dead_list_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _particle_counters_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = frame->arguments_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = frame->spawn_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _particle_velocity_buffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _particle_velocity_buffers[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _particle_color_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		};
+
+		VkWriteDescriptorSet write_descriptor_sets[PHYSICS_DATA_BINDINGS_COUNT];
+
+		for (uint32_t j = 0; j < PHYSICS_DATA_BINDINGS_COUNT; j += 1)
+		{
+			VkWriteDescriptorSet write_descriptor_set = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = frame->physics_descriptor_sets[i],
+				.dstBinding = j,
+				.dstArrayElement = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.pBufferInfo = buffer_infos + j,
+			};
+
+			write_descriptor_sets[j] = write_descriptor_set;
+		}
+
+		vkUpdateDescriptorSets(_device, PHYSICS_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+	}
+
+	return true;
+}
+/*
+	Radix sort buffers are shared by the depth sort of blended particles
+	and the Morton code sort of the gravity tree, they never run at once.
+*/
+static bool _uses_radix_sort()
+{
+	return _render_settings.blend_particles || _render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE;
+}
+static bool _create_sort_descriptor_sets()
+{
+	VkDescriptorSetLayout set_layouts[2] = {
+		_sort_descriptor_set_layout,
+		_sort_descriptor_set_layout,
+	};
+
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = _descriptor_pool,
+		.pSetLayouts = set_layouts,
+		.descriptorSetCount = 2,
+	};
+
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, _sort_descriptor_sets));
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		VkDescriptorBufferInfo buffer_infos[SORT_DATA_BINDINGS_COUNT] = {
+			{ .buffer = _sort_key_buffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _sort_value_buffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _sort_key_buffers[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _sort_value_buffers[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _sort_histogram_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = _sort_arguments_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		};
+
+		VkWriteDescriptorSet write_descriptor_sets[SORT_DATA_BINDINGS_COUNT];
+
+		for (uint32_t j = 0; j < SORT_DATA_BINDINGS_COUNT; j += 1)
+		{
+			VkWriteDescriptorSet write_descriptor_set = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = _sort_descriptor_sets[i],
+				.dstBinding = j,
+				.dstArrayElement = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.pBufferInfo = buffer_infos + j,
+			};
+
+			write_descriptor_sets[j] = write_descriptor_set;
+		}
+
+		vkUpdateDescriptorSets(_device, SORT_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+	}
+
+	return true;
+}
+static bool _create_fluid_descriptor_set()
+{
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = _descriptor_pool,
+		.pSetLayouts = &_fluid_descriptor_set_layout,
+		.descriptorSetCount = 1,
+	};
+
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, &_fluid_descriptor_set));
+
+	VkDescriptorBufferInfo buffer_infos[FLUID_DATA_BINDINGS_COUNT] = {
+		{ .buffer = _fluid_parameters_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_entry_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_cell_count_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_cell_start_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_cell_end_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_block_sum_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _grid_sorted_particle_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _fluid_density_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _fluid_acceleration_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+	};
+
+	VkWriteDescriptorSet write_descriptor_sets[FLUID_DATA_BINDINGS_COUNT];
+
+	for (uint32_t i = 0; i < FLUID_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkWriteDescriptorSet write_descriptor_set = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = _fluid_descriptor_set,
+			.dstBinding = i,
+			.dstArrayElement = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.pBufferInfo = buffer_infos + i,
+		};
+
+		write_descriptor_sets[i] = write_descriptor_set;
+	}
+
+	vkUpdateDescriptorSets(_device, FLUID_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+
+	return true;
+}
+static bool _create_gravity_tree_descriptor_set()
+{
+	VkDescriptorSetAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = _descriptor_pool,
+		.pSetLayouts = &_gravity_tree_descriptor_set_layout,
+		.descriptorSetCount = 1,
+	};
+
+	PROCESS_VK_RESULT(vkAllocateDescriptorSets(_device, &alloc_info, &_gravity_tree_descriptor_set));
+
+	VkDescriptorBufferInfo buffer_infos[GRAVITY_TREE_DATA_BINDINGS_COUNT] = {
+		{ .buffer = _gravity_tree_bounds_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _gravity_tree_node_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _gravity_tree_leaf_parent_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = _gravity_tree_node_data_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+	};
+
+	VkWriteDescriptorSet write_descriptor_sets[GRAVITY_TREE_DATA_BINDINGS_COUNT];
+
+	for (uint32_t i = 0; i < GRAVITY_TREE_DATA_BINDINGS_COUNT; i += 1)
+	{
+		VkWriteDescriptorSet write_descriptor_set = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = _gravity_tree_descriptor_set,
+			.dstBinding = i,
+			.dstArrayElement = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.pBufferInfo = buffer_infos + i,
+		};
+
+		write_descriptor_sets[i] = write_descriptor_set;
+	}
+
+	vkUpdateDescriptorSets(_device, GRAVITY_TREE_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+
+	return true;
+}
+static bool _create_descriptor_sets()
+{
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		PROCESS_RESULT(_create_descriptor_set(_frames.data + i));
+		PROCESS_RESULT(_create_physics_descriptor_sets(_frames.data + i));
+	}
+
+	if (_uses_radix_sort())
+	{
+		PROCESS_RESULT(_create_sort_descriptor_sets());
+	}
+
+	if (_render_settings.physics.fluid.enabled)
+	{
+		PROCESS_RESULT(_create_fluid_descriptor_set());
+	}
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+	{
+		PROCESS_RESULT(_create_gravity_tree_descriptor_set());
+	}
+
+	return true;
+}
+/*
+	Written by the expansion pass every frame, no upload needed.
+*/
+static bool _create_vertex_buffer()
+{
+	VkDeviceSize buffer_size = _get_vertex_stride() * 4 * _physics_constants.particle_capacity;
+
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&(frame->vertex_buffer),
+				&(frame->vertex_buffer_memory)
+			)
+		);
+	}
+
+	return true;
+}
+static bool _create_index_buffer()
+{
+	VkDeviceSize buffer_size = sizeof(uint32_t) * 6 * _physics_constants.particle_capacity;
+
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&(frame->index_buffer),
+				&(frame->index_buffer_memory)
+			)
+		);
+	}
+
+	return true;
+}
+/*
+	Triangle strip 0 1 3 2 keeps the winding of quads expanded by shader.comp.
+*/
+static bool _create_quad_vertex_buffer()
+{
+	Vector2 corners[QUAD_STRIP_VERTICES_COUNT] = {
+		{ -1.0f,  1.0f },
+		{ -1.0f, -1.0f },
+		{  1.0f,  1.0f },
+		{  1.0f, -1.0f },
+	};
+
+	PROCESS_RESULT(
+		_create_memory_buffer(
+			sizeof(corners),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&_quad_vertex_buffer,
+			&_quad_vertex_buffer_memory
+		)
+	);
+
+	return enqueue_buffer_upload(_quad_vertex_buffer, 0, corners, sizeof(corners));
+}
+/*
+	Written by the physics pass every frame, no upload needed.
+*/
+static bool _create_particle_buffer()
+{
+	VkDeviceSize buffer_size = _get_particle_stride() * _physics_constants.particle_capacity;
+
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&(frame->particle_buffer),
+				&(frame->particle_buffer_memory)
+			)
+		);
+	}
+
+	return true;
+}
+static bool _create_arguments_buffer()
+{
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(FrameArguments),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&(frame->arguments_buffer),
+				&(frame->arguments_buffer_memory)
+			)
+		);
+	}
+
+	return true;
+}
+/*
+	Spawned particles of a frame are uploaded here in one batch,
+	the emit pass of the same frame copies them into free slots.
+*/
+static bool _create_spawn_buffer()
+{
+	VkDeviceSize buffer_size = sizeof(ParticleState) * _spawn_buffer_capacity;
+
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&(frame->spawn_buffer),
+				&(frame->spawn_buffer_memory)
+			)
+		);
+	}
+
+	return true;
+}
+static bool _create_particle_state_buffers()
+{
+	uint32_t capacity = _physics_constants.particle_capacity;
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(Vector4) * capacity,
+				usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_particle_position_buffers + i,
+				_particle_position_buffers_memory + i
+			)
+		);
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(Vector4) * capacity,
+				usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_particle_velocity_buffers + i,
+				_particle_velocity_buffers_memory + i
+			)
+		);
+	}
+
+	return _create_memory_buffer(
+		sizeof(Color) * capacity,
+		usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&_particle_color_buffer,
+		&_particle_color_buffer_memory
+	);
+}
+static void _destroy_particle_state_buffers()
+{
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		_destroy_memory_buffer(_particle_position_buffers + i, _particle_position_buffers_memory + i);
+		_destroy_memory_buffer(_particle_velocity_buffers + i, _particle_velocity_buffers_memory + i);
+	}
+
+	_destroy_memory_buffer(&_particle_color_buffer, &_particle_color_buffer_memory);
+}
+/*
+	Alive lists start with their count.
+*/
+static bool _create_particle_list_buffers()
+{
+	uint32_t capacity = _physics_constants.particle_capacity;
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(uint32_t) * (1 + capacity),
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_alive_list_buffers + i,
+				_alive_list_buffers_memory + i
+			)
+		);
+	}
+
+	return _create_memory_buffer(
+		sizeof(uint32_t) * capacity,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&_dead_list_buffer,
+		&_dead_list_buffer_memory
+	);
+}
+static bool _create_particle_counters_buffer()
+{
+	return _create_memory_buffer(
+		sizeof(ParticleCounters),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&_particle_counters_buffer,
+		&_particle_counters_buffer_memory
+	);
+}
+/*
+	Sorted every frame from scratch, no upload needed.
+*/
+static bool _create_sort_buffers()
+{
+	VkDeviceSize buffer_size = sizeof(uint32_t) * _physics_constants.particle_capacity;
+
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_sort_key_buffers + i,
+				_sort_key_buffers_memory + i
+			)
+		);
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffer_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_sort_value_buffers + i,
+				_sort_value_buffers_memory + i
+			)
+		);
+	}
+
+	PROCESS_RESULT(
+		_create_memory_buffer(
+			sizeof(uint32_t) * RADIX_SORT_WORKGROUP_SIZE * RADIX_SORT_MAX_GROUP_COUNT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&_sort_histogram_buffer,
+			&_sort_histogram_buffer_memory
+		)
+	);
+
+	return _create_memory_buffer(
+		sizeof(SortArguments),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&_sort_arguments_buffer,
+		&_sort_arguments_buffer_memory
+	);
+}
+static void _destroy_sort_buffers()
+{
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		_destroy_memory_buffer(_sort_key_buffers + i, _sort_key_buffers_memory + i);
+		_destroy_memory_buffer(_sort_value_buffers + i, _sort_value_buffers_memory + i);
+	}
+
+	_destroy_memory_buffer(&_sort_histogram_buffer, &_sort_histogram_buffer_memory);
+	_destroy_memory_buffer(&_sort_arguments_buffer, &_sort_arguments_buffer_memory);
+}
+/*
+	Hash table has a power of two size close to the particle capacity,
+	within what a two level scan of FLUID_GRID_SCAN_BLOCK_SIZE blocks covers.
+	Cell counts start at zero, parameters are uploaded with the table size.
+*/
+static bool _create_fluid_buffers()
+{
+	uint32_t capacity = _physics_constants.particle_capacity;
+	const FluidSettings *fluid = &(_render_settings.physics.fluid);
+
+	_grid_table_size = FLUID_GRID_SCAN_BLOCK_SIZE;
+
+	while (_grid_table_size < capacity && _grid_table_size < FLUID_GRID_MAX_TABLE_SIZE)
+	{
+		_grid_table_size *= 2;
+	}
+
+	struct
+	{
+		VkDeviceSize size;
+		VkBufferUsageFlags usage;
+		VkBuffer *buffer;
+		DeviceMemoryAllocation *buffer_memory;
+
+	} buffers[FLUID_DATA_BINDINGS_COUNT] = {
+		{ sizeof(FluidParameters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, &_fluid_parameters_buffer, &_fluid_parameters_buffer_memory },
+		{ sizeof(uint32_t) * 2 * capacity, 0, &_grid_entry_buffer, &_grid_entry_buffer_memory },
+		{ sizeof(uint32_t) * _grid_table_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, &_grid_cell_count_buffer, &_grid_cell_count_buffer_memory },
+		{ sizeof(uint32_t) * _grid_table_size, 0, &_grid_cell_start_buffer, &_grid_cell_start_buffer_memory },
+		{ sizeof(uint32_t) * _grid_table_size, 0, &_grid_cell_end_buffer, &_grid_cell_end_buffer_memory },
+		{ sizeof(uint32_t) * FLUID_GRID_SCAN_BLOCK_SIZE, 0, &_grid_block_sum_buffer, &_grid_block_sum_buffer_memory },
+		{ sizeof(uint32_t) * capacity, 0, &_grid_sorted_particle_buffer, &_grid_sorted_particle_buffer_memory },
+		{ sizeof(float) * 2 * capacity, 0, &_fluid_density_buffer, &_fluid_density_buffer_memory },
+		{ sizeof(Vector4) * capacity, 0, &_fluid_acceleration_buffer, &_fluid_acceleration_buffer_memory },
+	};
+
+	for (uint32_t i = 0; i < FLUID_DATA_BINDINGS_COUNT; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffers[i].size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | buffers[i].usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				buffers[i].buffer,
+				buffers[i].buffer_memory
+			)
+		);
+	}
+
+	PROCESS_RESULT(_begin_one_time_command());
+
+	vkCmdFillBuffer(_command_buffers.data[_one_time_command_buffer_idx], _grid_cell_count_buffer, 0, VK_WHOLE_SIZE, 0);
+
+	PROCESS_RESULT(_submit_one_time_command());
+
+	float radius = fluid->smoothing_radius;
+
+	FluidParameters parameters = {
+		.smoothing_radius = radius,
+		.particle_mass = fluid->particle_mass,
+		.rest_density = fluid->rest_density,
+		.stiffness = fluid->stiffness,
+		.viscosity = fluid->viscosity,
+		.poly6_scale = 315.0f / (64.0f * (float)M_PI * powf(radius, 9.0f)),
+		.spiky_scale = 45.0f / ((float)M_PI * powf(radius, 6.0f)),
+		.grid_table_size = _grid_table_size,
+	};
+
+	return enqueue_buffer_upload(_fluid_parameters_buffer, 0, &parameters, sizeof(parameters));
+}
+static void _destroy_fluid_buffers()
+{
+	_destroy_memory_buffer(&_fluid_parameters_buffer, &_fluid_parameters_buffer_memory);
+	_destroy_memory_buffer(&_grid_entry_buffer, &_grid_entry_buffer_memory);
+	_destroy_memory_buffer(&_grid_cell_count_buffer, &_grid_cell_count_buffer_memory);
+	_destroy_memory_buffer(&_grid_cell_start_buffer, &_grid_cell_start_buffer_memory);
+	_destroy_memory_buffer(&_grid_cell_end_buffer, &_grid_cell_end_buffer_memory);
+	_destroy_memory_buffer(&_grid_block_sum_buffer, &_grid_block_sum_buffer_memory);
+	_destroy_memory_buffer(&_grid_sorted_particle_buffer, &_grid_sorted_particle_buffer_memory);
+	_destroy_memory_buffer(&_fluid_density_buffer, &_fluid_density_buffer_memory);
+	_destroy_memory_buffer(&_fluid_acceleration_buffer, &_fluid_acceleration_buffer_memory);
+}
+/*
+	Tree is rebuilt every step from scratch, no upload needed.
+	N alive particles take N - 1 internal nodes.
+*/
+static bool _create_gravity_tree_buffers()
+{
+	uint32_t capacity = _physics_constants.particle_capacity;
+
+	struct
+	{
+		VkDeviceSize size;
+		VkBuffer *buffer;
+		DeviceMemoryAllocation *buffer_memory;
+
+	} buffers[GRAVITY_TREE_DATA_BINDINGS_COUNT] = {
+		{ sizeof(uint32_t) * 6, &_gravity_tree_bounds_buffer, &_gravity_tree_bounds_buffer_memory },
+		{ sizeof(uint32_t) * 4 * capacity, &_gravity_tree_node_buffer, &_gravity_tree_node_buffer_memory },
+		{ sizeof(uint32_t) * capacity, &_gravity_tree_leaf_parent_buffer, &_gravity_tree_leaf_parent_buffer_memory },
+		{ sizeof(Vector4) * 3 * capacity, &_gravity_tree_node_data_buffer, &_gravity_tree_node_data_buffer_memory },
+	};
+
+	for (uint32_t i = 0; i < GRAVITY_TREE_DATA_BINDINGS_COUNT; i += 1)
+	{
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				buffers[i].size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				buffers[i].buffer,
+				buffers[i].buffer_memory
+			)
+		);
+	}
+
+	return true;
+}
+static void _destroy_gravity_tree_buffers()
+{
+	_destroy_memory_buffer(&_gravity_tree_bounds_buffer, &_gravity_tree_bounds_buffer_memory);
+	_destroy_memory_buffer(&_gravity_tree_node_buffer, &_gravity_tree_node_buffer_memory);
+	_destroy_memory_buffer(&_gravity_tree_leaf_parent_buffer, &_gravity_tree_leaf_parent_buffer_memory);
+	_destroy_memory_buffer(&_gravity_tree_node_data_buffer, &_gravity_tree_node_data_buffer_memory);
+}
+/*
+	Puts slots [first_slot, end_slot) at the bottom of the dead stack,
+	lower slots closer to the top.
+*/
+static bool _upload_dead_slots(uint32_t first_slot, uint32_t end_slot)
+{
+	uint32_t count = end_slot - first_slot;
+
+	if (count == 0)
+	{
+		return true;
+	}
+
+	uint32_t *dead_list = (uint32_t *)malloc(sizeof(uint32_t) * count);
+
+	PROCESS_RESULT(dead_list != NULL);
+
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		dead_list[i] = end_slot - 1 - i;
+	}
+
+	bool result = enqueue_buffer_upload(_dead_list_buffer, 0, dead_list, sizeof(uint32_t) * count);
+
+	free(dead_list);
+
+	return result;
+}
+/*
+	Particles of create_particles start at rest and never die,
+	they take the first slots, the rest of the slots is dead.
+	The second state is written by the first physics step.
+*/
+static bool _upload_initial_particles()
+{
+	uint32_t alive_count = _particles.count;
+
+	Vector4 *velocities = (Vector4 *)malloc(sizeof(Vector4) * alive_count);
+	uint32_t *alive_list = (uint32_t *)malloc(sizeof(uint32_t) * (1 + alive_count));
+
+	bool result = velocities != NULL && alive_list != NULL;
+
+	if (result)
+	{
+		alive_list[0] = alive_count;
+
+		for (uint32_t i = 0; i < alive_count; i += 1)
+		{
+			Vector4 velocity = { 0.0f, 0.0f, 0.0f, INFINITY };
+
+			velocities[i] = velocity;
+			alive_list[1 + i] = i;
+		}
+
+		ParticleCounters counters = {
+			.emit_count = 0,
+			.spawn_count = 0,
+			.dead_count = _physics_constants.particle_capacity - alive_count,
+		};
+
+		_particle_state_idx = 0;
+		_persistent_particles_count = alive_count;
+
+		result = (
+			(
+				alive_count == 0 || (
+					enqueue_buffer_upload(_particle_position_buffers[0], 0, _particles.positions, sizeof(Vector4) * alive_count) &&
+					enqueue_buffer_upload(_particle_velocity_buffers[0], 0, velocities, sizeof(Vector4) * alive_count) &&
+					enqueue_buffer_upload(_particle_color_buffer, 0, _particles.colors, sizeof(Color) * alive_count)
+				)
+			) &&
+			enqueue_buffer_upload(_alive_list_buffers[0], 0, alive_list, sizeof(uint32_t) * (1 + alive_count)) &&
+			_upload_dead_slots(alive_count, _physics_constants.particle_capacity) &&
+			enqueue_buffer_upload(_particle_counters_buffer, 0, &counters, sizeof(counters))
+		);
+	}
+
+	free(velocities);
+	free(alive_list);
+
+	return result;
+}
+/*
+	Rare, capacity and spawn buffers grow geometrically. Waits for the device,
+	as buffers and descriptor sets of every frame in flight are replaced.
+	Current state and alive list are copied on GPU, old dead slots move up
+	the dead stack and new slots fill its bottom. The dead counter is raised
+	by the next step arguments pass.
+*/
+static bool _grow_particle_storage(uint32_t capacity, uint32_t spawn_buffer_capacity)
+{
+	PROCESS_VK_RESULT(vkDeviceWaitIdle(_device));
+
+	if (spawn_buffer_capacity > _spawn_buffer_capacity)
+	{
+		for (uint32_t i = 0; i < _frames.count; i += 1)
+		{
+			_destroy_memory_buffer(&(_frames.data[i].spawn_buffer), &(_frames.data[i].spawn_buffer_memory));
+		}
+
+		_spawn_buffer_capacity = spawn_buffer_capacity;
+
+		PROCESS_RESULT(_create_spawn_buffer());
+	}
+
+	uint32_t old_capacity = _physics_constants.particle_capacity;
+
+	if (capacity > old_capacity)
+	{
+		uint32_t current_idx = _particle_state_idx;
+
+		VkBuffer old_position_buffers[2] = { _particle_position_buffers[0], _particle_position_buffers[1] };
+		VkBuffer old_velocity_buffers[2] = { _particle_velocity_buffers[0], _particle_velocity_buffers[1] };
+		VkBuffer old_color_buffer = _particle_color_buffer;
+		VkBuffer old_alive_list_buffers[2] = { _alive_list_buffers[0], _alive_list_buffers[1] };
+		VkBuffer old_dead_list_buffer = _dead_list_buffer;
+
+		DeviceMemoryAllocation old_position_buffers_memory[2] = {
+			_particle_position_buffers_memory[0],
+			_particle_position_buffers_memory[1],
+		};
+		DeviceMemoryAllocation old_velocity_buffers_memory[2] = {
+			_particle_velocity_buffers_memory[0],
+			_particle_velocity_buffers_memory[1],
+		};
+		DeviceMemoryAllocation old_color_buffer_memory = _particle_color_buffer_memory;
+		DeviceMemoryAllocation old_alive_list_buffers_memory[2] = {
+			_alive_list_buffers_memory[0],
+			_alive_list_buffers_memory[1],
+		};
+		DeviceMemoryAllocation old_dead_list_buffer_memory = _dead_list_buffer_memory;
+
+		_physics_constants.particle_capacity = capacity;
+
+		PROCESS_RESULT(_create_particle_state_buffers());
+		PROCESS_RESULT(_create_particle_list_buffers());
+
+		/*
+			New dead slots are staged here instead of going through the upload
+			manager, whose transfer queue may belong to another family.
+			Every write of the growth is one submission on the compute queue,
+			the buffers never change owner before the physics passes read them.
+		*/
+		uint32_t added_count = capacity - old_capacity;
+
+		VkBuffer dead_slots_staging_buffer;
+		DeviceMemoryAllocation dead_slots_staging_buffer_memory;
+
+		PROCESS_RESULT(
+			_create_memory_buffer(
+				sizeof(uint32_t) * added_count,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&dead_slots_staging_buffer,
+				&dead_slots_staging_buffer_memory
+			)
+		);
+
+		uint32_t *dead_slots = (uint32_t *)dead_slots_staging_buffer_memory.mapped;
+
+		for (uint32_t i = 0; i < added_count; i += 1)
+		{
+			dead_slots[i] = capacity - 1 - i;
+		}
+
+		PROCESS_RESULT(_begin_one_time_command());
+
+		VkCommandBuffer command_buffer = _command_buffers.data[_one_time_command_buffer_idx];
+
+		VkBufferCopy vector_stream_copy = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = sizeof(Vector4) * old_capacity,
+		};
+
+		VkBufferCopy color_stream_copy = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = sizeof(Color) * old_capacity,
+		};
+
+		VkBufferCopy alive_list_copy = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = sizeof(uint32_t) * (1 + old_capacity),
+		};
+
+		VkBufferCopy dead_list_copy = {
+			.srcOffset = 0,
+			.dstOffset = sizeof(uint32_t) * added_count,
+			.size = sizeof(uint32_t) * old_capacity,
+		};
+
+		VkBufferCopy dead_slots_copy = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = sizeof(uint32_t) * added_count,
+		};
+
+		vkCmdCopyBuffer(command_buffer, old_position_buffers[current_idx], _particle_position_buffers[current_idx], 1, &vector_stream_copy);
+		vkCmdCopyBuffer(command_buffer, old_velocity_buffers[current_idx], _particle_velocity_buffers[current_idx], 1, &vector_stream_copy);
+		vkCmdCopyBuffer(command_buffer, old_color_buffer, _particle_color_buffer, 1, &color_stream_copy);
+		vkCmdCopyBuffer(command_buffer, old_alive_list_buffers[current_idx], _alive_list_buffers[current_idx], 1, &alive_list_copy);
+		vkCmdCopyBuffer(command_buffer, old_dead_list_buffer, _dead_list_buffer, 1, &dead_list_copy);
+		vkCmdCopyBuffer(command_buffer, dead_slots_staging_buffer, _dead_list_buffer, 1, &dead_slots_copy);
+
+		bool submitted = _submit_one_time_command_to_queue(_compute_queue);
+
+		_destroy_memory_buffer(&dead_slots_staging_buffer, &dead_slots_staging_buffer_memory);
+
+		PROCESS_RESULT(submitted);
+
+		for (uint32_t i = 0; i < 2; i += 1)
+		{
+			_destroy_memory_buffer(old_position_buffers + i, old_position_buffers_memory + i);
+			_destroy_memory_buffer(old_velocity_buffers + i, old_velocity_buffers_memory + i);
+			_destroy_memory_buffer(old_alive_list_buffers + i, old_alive_list_buffers_memory + i);
+		}
+
+		_destroy_memory_buffer(&old_color_buffer, &old_color_buffer_memory);
+
+		_destroy_memory_buffer(&old_dead_list_buffer, &old_dead_list_buffer_memory);
+
+		_physics_added_slots_count += capacity - old_capacity;
+
+		/*
+			Per frame outputs are written every frame, nothing to copy.
+		*/
+		for (uint32_t i = 0; i < _frames.count; i += 1)
+		{
+			FrameResources *frame = _frames.data + i;
+
+			_destroy_memory_buffer(&(frame->particle_buffer), &(frame->particle_buffer_memory));
+			_destroy_memory_buffer(&(frame->vertex_buffer), &(frame->vertex_buffer_memory));
+			_destroy_memory_buffer(&(frame->index_buffer), &(frame->index_buffer_memory));
+		}
+
+		PROCESS_RESULT(_create_particle_buffer());
+
+		if (_render_settings.render_path == RENDER_PATH_COMPUTE_EXPANDED)
+		{
+			PROCESS_RESULT(_create_vertex_buffer());
+			PROCESS_RESULT(_create_index_buffer());
+		}
+
+		if (_uses_radix_sort())
+		{
+			_destroy_sort_buffers();
+
+			PROCESS_RESULT(_create_sort_buffers());
+		}
+
+		if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+		{
+			_destroy_gravity_tree_buffers();
+
+			PROCESS_RESULT(_create_gravity_tree_buffers());
+		}
+
+		/*
+			Parameters upload goes with the spawned particles of the frame.
+		*/
+		if (_render_settings.physics.fluid.enabled)
+		{
+			_destroy_fluid_buffers();
+
+			PROCESS_RESULT(_create_fluid_buffers());
+		}
+	}
+
+	PROCESS_VK_RESULT(vkResetDescriptorPool(_device, _descriptor_pool, VK_FLAGS_NONE));
+
+	return _create_descriptor_sets();
+}
+/*
+	Uploads particles spawned since the previous frame in one batch.
+	Capacity keeps room for every persistent particle plus
+	the particles emission may keep alive at once.
+*/
+static bool _upload_spawned_particles(FrameResources *frame)
+{
+	_physics_spawn_count = 0;
+
+	if (_spawned_particles.count == 0)
+	{
+		return true;
+	}
+
+	const PhysicsSettings *physics = &(_render_settings.physics);
+
+	uint64_t emission_reserve = (uint64_t)ceil(
+		physics->emission_rate * (physics->particle_life_time + physics->time_step * physics->max_steps_per_frame)
+	);
+	uint64_t required_capacity = (uint64_t)_persistent_particles_count + _spawned_particles.count + emission_reserve;
+
+	PROCESS_RESULT(required_capacity <= UINT32_MAX);
+
+	uint32_t capacity = _physics_constants.particle_capacity;
+	uint32_t spawn_buffer_capacity = _spawn_buffer_capacity;
+
+	while (capacity < required_capacity)
+	{
+		capacity = capacity <= UINT32_MAX / 2 ? capacity * 2 : (uint32_t)required_capacity;
+	}
+
+	while (spawn_buffer_capacity < _spawned_particles.count)
+	{
+		spawn_buffer_capacity *= 2;
+	}
+
+	if (capacity > _physics_constants.particle_capacity || spawn_buffer_capacity > _spawn_buffer_capacity)
+	{
+		PROCESS_RESULT(_grow_particle_storage(capacity, spawn_buffer_capacity));
+	}
+
+	PROCESS_RESULT(
+		enqueue_buffer_upload(
+			frame->spawn_buffer, 0,
+			_spawned_particles.data, sizeof(ParticleState) * _spawned_particles.count
+		)
+	);
+	PROCESS_RESULT(submit_uploads());
+
+	_physics_spawn_count = _spawned_particles.count;
+	_persistent_particles_count += _spawned_particles.count;
+	_spawned_particles.count = 0;
+
+	return true;
+}
+static bool _create_framebuffers()
+{
+	_swap_chain_framebuffers.count = _swap_chain_image_views.count;
+	_swap_chain_framebuffers.data = malloc(sizeof(SwapChainFramebuffers) * _swap_chain_framebuffers.count);
+
+	for (uint32_t i = 0; i < _swap_chain_framebuffers.count; i++)
+	{
+		VkImageView attachments[2] = {
+			_swap_chain_image_views.data[i],
+			_depth_image_view
+		};
+
+		VkFramebufferCreateInfo framebufferInfo = {
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = _render_pass,
+			.attachmentCount = 2,
+			.pAttachments = attachments,
+			.width = _swap_chain_image_extent.width,
+			.height = _swap_chain_image_extent.height,
+			.layers = 1,
+		};
+
+		PROCESS_VK_RESULT(vkCreateFramebuffer(_device, &framebufferInfo, NULL, _swap_chain_framebuffers.data + i));
+	}
+
+	return true;
+}
+/*
+	One image draw command buffer per frame in flight, recorded every frame
+	for the acquired image, so their count does not depend on the swap chain.
+*/
+static uint32_t _get_image_draw_command_buffer_idx(uint32_t frame_idx)
+{
+	return _image_draw_command_buffers_begin_idx + frame_idx;
+}
+static bool _allocate_image_draw_command_buffers()
+{
+	VkCommandBufferAllocateInfo image_draw_cb_ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = _long_live_buffers_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = _frames.count,
+	};
+
+	return vkAllocateCommandBuffers(_device, &image_draw_cb_ai, _command_buffers.data + _image_draw_command_buffers_begin_idx) == VK_SUCCESS;
+}
+static bool _allocate_compute_command_buffers()
+{
+	VkCommandBufferAllocateInfo compute_cb_ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = _long_live_buffers_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = _frames.count,
+	};
+
+	return vkAllocateCommandBuffers(_device, &compute_cb_ai, _command_buffers.data + _compute_command_buffers_begin_idx) == VK_SUCCESS;
+}
+static bool _create_command_pools_and_allocate_buffers()
+{
+	VkCommandPoolCreateInfo long_live_buffers_pool_ci = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // _operation_queue_families.use_same_family == true
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,  // frame command buffers are recorded every frame
+	};
+
+	VkCommandPoolCreateInfo one_time_buffers_pool_ci = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // _operation_queue_families.use_same_family == true
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	};
+
+	_one_time_command_buffer_idx = 0;
+	_compute_command_buffers_begin_idx = 1;
+	_image_draw_command_buffers_begin_idx = _compute_command_buffers_begin_idx + _frames.count;
+
+	_command_buffers.count = 1 + 2 * _frames.count;
+	_command_buffers.data = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * _command_buffers.count);
+
+	PROCESS_VK_RESULT(vkCreateCommandPool(_device, &long_live_buffers_pool_ci, NULL, &_long_live_buffers_pool));
+	PROCESS_VK_RESULT(vkCreateCommandPool(_device, &one_time_buffers_pool_ci, NULL, &_one_time_buffers_pool));
+
+	VkCommandBufferAllocateInfo one_time_buffer_ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = _one_time_buffers_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	return (
+		vkAllocateCommandBuffers(_device, &one_time_buffer_ai, _command_buffers.data) == VK_SUCCESS &&
+		_allocate_image_draw_command_buffers() &&
+		_allocate_compute_command_buffers()
+	);
+}
+static bool _write_image_draw_command_buffer(uint32_t frame_idx, uint32_t image_idx)
+{
+	FrameResources *frame = _frames.data + frame_idx;
+	VkCommandBuffer command_buffer = _command_buffers.data[_get_image_draw_command_buffer_idx(frame_idx)];
+
+	VkCommandBufferBeginInfo beginInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = NULL, // Optional
+	};
+	vkBeginCommandBuffer(command_buffer, &beginInfo);
+
+	begin_gpu_timeline(command_buffer, "graphics");
+
+	VkRenderPassBeginInfo renderPassInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = _render_pass,
+		.framebuffer = _swap_chain_framebuffers.data[image_idx],
+		.renderArea.offset = { 0, 0 },
+		.renderArea.extent = _swap_chain_image_extent,
+	};
+
+	VkClearValue clearValues[2];
+	VkClearColorValue clear_color = {
+		.float32 = { 0.0f, 0.0f, 0.0f, 0.0f },
+	};
+	VkClearDepthStencilValue clear_depth_stencil = {
+		.depth = 1.0f,
+		.stencil = 0,
+	};
+	clearValues[0].color = clear_color;
+	clearValues[1].depthStencil = clear_depth_stencil;
+
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+
+	vkCmdBeginRenderPass(command_buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
+
+	VkViewport viewport = {
+		.x = 0.0f,
+		.y = 0.0f,
+		.width = (float)(_swap_chain_image_extent.width),
+		.height = (float)(_swap_chain_image_extent.height),
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	};
+
+	VkRect2D scissor = {
+		.offset = { 0, 0 },
+		.extent = _swap_chain_image_extent,
+	};
+
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+	VkDeviceSize offsets[] = { 0 };
+
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		_graphics_pipeline_layout, 0, 1,
+		&(frame->descriptor_set), 0, NULL
+	);
+	vkCmdPushConstants(
+		command_buffer,
+		_graphics_pipeline_layout,
+		VK_SHADER_STAGE_VERTEX_BIT,
+		0, sizeof(FrameConstants), &_frame_constants
+	);
+
+	if (_render_settings.render_path == RENDER_PATH_VERTEX_PULLING)
+	{
+		vkCmdDrawIndirect(command_buffer, frame->arguments_buffer, offsetof(FrameArguments, pulling_draw), 1, sizeof(VkDrawIndirectCommand));
+	}
+	else if (_render_settings.render_path == RENDER_PATH_INSTANCED)
+	{
+		VkBuffer instanced_buffers[2] = {
+			_quad_vertex_buffer,
+			frame->particle_buffer,
+		};
+
+		VkDeviceSize instanced_offsets[2] = { 0, 0 };
+
+		vkCmdBindVertexBuffers(command_buffer, 0, 2, instanced_buffers, instanced_offsets);
+		vkCmdDrawIndirect(command_buffer, frame->arguments_buffer, offsetof(FrameArguments, instanced_draw), 1, sizeof(VkDrawIndirectCommand));
+	}
+	else
+	{
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, &(frame->vertex_buffer), offsets);
+		vkCmdBindIndexBuffer(command_buffer, frame->index_buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexedIndirect(command_buffer, frame->arguments_buffer, offsetof(FrameArguments, indexed_draw), 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	vkCmdEndRenderPass(command_buffer);
+
+	mark_gpu_pass(command_buffer, "render_pass");
+
+	return vkEndCommandBuffer(command_buffer) == VK_SUCCESS;
+}
+/*
+	Uniform grid build and SPH passes of a step, after emit and before physics.
+	Alive particles are counted into hashed cells, counts are scanned into
+	cell start and end tables and particles are counting sorted by cell.
+	Density and forces passes iterate the 27 cells around every particle only.
+	Physics set of the step stays bound as set 0.
+*/
+static void _write_fluid_commands(VkCommandBuffer command_buffer)
+{
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+
+	uint32_t scan_group_count = _grid_table_size / FLUID_GRID_SCAN_BLOCK_SIZE;
+
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_physics_pipeline_layout, 1, 1,
+		&_fluid_descriptor_set, 0, NULL
+	);
+
+	struct
+	{
+		VkPipeline pipeline;
+		uint32_t group_count;  /* 0 for one invocation per alive particle */
+		const char *name;
+
+	} passes[] = {
+		{ _grid_count_pipeline, 0, "grid_count" },
+		{ _grid_scan_pipeline, scan_group_count, "grid_scan" },
+		{ _grid_scan_blocks_pipeline, 1, "grid_scan_blocks" },
+		{ _grid_scan_add_pipeline, scan_group_count, "grid_scan_add" },
+		{ _grid_scatter_pipeline, 0, "grid_scatter" },
+		{ _sph_density_pipeline, 0, "sph_density" },
+		{ _sph_forces_pipeline, 0, "sph_forces" },
+	};
+
+	for (uint32_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i += 1)
+	{
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, passes[i].pipeline);
+
+		if (passes[i].group_count == 0)
+		{
+			vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+		}
+		else
+		{
+			vkCmdDispatch(command_buffer, passes[i].group_count, 1, 1);
+		}
+
+		mark_gpu_pass(command_buffer, passes[i].name);
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "fluid_barrier");
+	}
+}
+/*
+	Least significant digit radix sort of depth keys written by the cull pass,
+	8 bits per pass. Every pass builds per-workgroup digit histograms,
+	scans them into output offsets and scatters keys and values stably.
+	Gather writes particles of the frame in sorted order.
+	Physics set of the frame stays bound as set 0.
+*/
+static void _write_sort_commands(VkCommandBuffer command_buffer, FrameResources *frame)
+{
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+
+	VkPipelineStageFlags barrier_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "sort_barrier");
+
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_frame_pass_pipeline_layout, 1, 1,
+		_sort_descriptor_sets, 0, NULL
+	);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _sort_arguments_pipeline);
+	vkCmdDispatch(command_buffer, 1, 1, 1);
+
+	mark_gpu_pass(command_buffer, "sort_arguments");
+
+	for (uint32_t i = 0; i < RADIX_SORT_PASSES_COUNT; i += 1)
+	{
+		uint32_t radix_shift = 8 * i;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "sort_barrier");
+
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			_frame_pass_pipeline_layout, 1, 1,
+			_sort_descriptor_sets + (i & 1), 0, NULL
+		);
+		vkCmdPushConstants(
+			command_buffer,
+			_frame_pass_pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			offsetof(FramePassConstants, radix_shift), sizeof(uint32_t), &radix_shift
+		);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _radix_histogram_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _sort_arguments_buffer, offsetof(SortArguments, sort_dispatch));
+
+		mark_gpu_pass(command_buffer, "radix_histogram");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "sort_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _radix_scan_pipeline);
+		vkCmdDispatch(command_buffer, 1, 1, 1);
+
+		mark_gpu_pass(command_buffer, "radix_scan");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "sort_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _radix_scatter_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _sort_arguments_buffer, offsetof(SortArguments, sort_dispatch));
+
+		mark_gpu_pass(command_buffer, "radix_scatter");
+	}
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "sort_barrier");
+
+	/*
+		An even number of passes leaves sorted keys and values in the first buffers.
+	*/
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_frame_pass_pipeline_layout, 1, 1,
+		_sort_descriptor_sets + (RADIX_SORT_PASSES_COUNT & 1), 0, NULL
+	);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _sort_gather_pipeline);
+	vkCmdDispatchIndirect(command_buffer, frame->arguments_buffer, offsetof(FrameArguments, expansion_dispatch));
+
+	mark_gpu_pass(command_buffer, "sort_gather");
+}
+/*
+	Barnes-Hut tree of a step: alive particles get Morton codes inside
+	their bounding box, codes are radix sorted and every internal node
+	of the radix tree over them is built in parallel. Centers of mass are
+	summarized from leaves up, then every particle walks the tree.
+	Physics set of the step stays bound as set 0, radix_shift pushes
+	leave the rest of the physics constants of the step as they are.
+*/
+static void _write_gravity_tree_commands(VkCommandBuffer command_buffer)
+{
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+
+	VkPipelineStageFlags barrier_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+
+	VkDescriptorSet tree_descriptor_sets[2] = {
+		_sort_descriptor_sets[0],
+		_gravity_tree_descriptor_set,
+	};
+
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_physics_pipeline_layout, 2, 2,
+		tree_descriptor_sets, 0, NULL
+	);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_arguments_pipeline);
+	vkCmdDispatch(command_buffer, 1, 1, 1);
+
+	mark_gpu_pass(command_buffer, "gravity_tree_arguments");
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "gravity_barrier");
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_bounds_pipeline);
+	vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+
+	mark_gpu_pass(command_buffer, "gravity_tree_bounds");
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "gravity_barrier");
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_morton_pipeline);
+	vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+
+	mark_gpu_pass(command_buffer, "gravity_tree_morton");
+
+	for (uint32_t i = 0; i < RADIX_SORT_PASSES_COUNT; i += 1)
+	{
+		uint32_t radix_shift = 8 * i;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "gravity_barrier");
+
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			_physics_pipeline_layout, 2, 1,
+			_sort_descriptor_sets + (i & 1), 0, NULL
+		);
+		vkCmdPushConstants(
+			command_buffer,
+			_physics_pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			offsetof(PhysicsConstants, radix_shift), sizeof(uint32_t), &radix_shift
+		);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_radix_histogram_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _sort_arguments_buffer, offsetof(SortArguments, sort_dispatch));
+
+		mark_gpu_pass(command_buffer, "gravity_tree_radix_histogram");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "gravity_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_radix_scan_pipeline);
+		vkCmdDispatch(command_buffer, 1, 1, 1);
+
+		mark_gpu_pass(command_buffer, "gravity_tree_radix_scan");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "gravity_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_tree_radix_scatter_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _sort_arguments_buffer, offsetof(SortArguments, sort_dispatch));
+
+		mark_gpu_pass(command_buffer, "gravity_tree_radix_scatter");
+	}
+
+	/*
+		An even number of passes leaves sorted codes and slots in the first buffers.
+	*/
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_physics_pipeline_layout, 2, 1,
+		_sort_descriptor_sets + (RADIX_SORT_PASSES_COUNT & 1), 0, NULL
+	);
+
+	VkPipeline tree_pipelines[] = {
+		_gravity_tree_build_pipeline,
+		_gravity_tree_summarize_pipeline,
+		_gravity_tree_forces_pipeline,
+	};
+
+	const char *tree_pass_names[] = {
+		"gravity_tree_build",
+		"gravity_tree_summarize",
+		"gravity_tree_forces",
+	};
+
+	for (uint32_t i = 0; i < sizeof(tree_pipelines) / sizeof(tree_pipelines[0]); i += 1)
+	{
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "gravity_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, tree_pipelines[i]);
+		vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+
+		mark_gpu_pass(command_buffer, tree_pass_names[i]);
+	}
+}
+/*
+	Kicks velocities of the state the physics pass of the step reads,
+	so mutual gravity is integrated with the rest of the forces.
+*/
+static void _write_gravity_commands(VkCommandBuffer command_buffer)
+{
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+	{
+		_write_gravity_tree_commands(command_buffer);
+	}
+	else
+	{
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gravity_direct_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+
+		mark_gpu_pass(command_buffer, "gravity_direct");
+	}
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "gravity_barrier");
+}
+/*
+	Every fixed step of the frame sizes its dispatches on GPU, emits
+	particles from the dead list and integrates the alive list into the other one.
+	A frame without a whole step still runs a zero length one, so particles
+	of the frame are written and parity flips the same way.
+	Arguments of the frame are written from the last alive list.
+*/
+static void _write_physics_commands(VkCommandBuffer command_buffer, FrameResources *frame)
+{
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+
+	VkPipelineStageFlags barrier_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+
+	PhysicsConstants physics_constants = _physics_constants;
+	uint32_t steps_count = _physics_steps_count;
+
+	if (steps_count == 0)
+	{
+		physics_constants.time_step = 0.0f;
+		steps_count = 1;
+	}
+
+	for (uint32_t i = 0; i < steps_count; i += 1)
+	{
+		/*
+			Particles emitted in the frame are spread evenly over its steps.
+		*/
+		physics_constants.emit_count = (uint32_t)(
+			(uint64_t)_physics_emit_count * (i + 1) / steps_count -
+			(uint64_t)_physics_emit_count * i / steps_count
+		);
+		physics_constants.seed = _physics_constants.seed + i;
+
+		/*
+			Spawned particles and slots added by growth go to the first step.
+		*/
+		physics_constants.spawn_count = i == 0 ? _physics_spawn_count : 0;
+		physics_constants.added_slots_count = i == 0 ? _physics_added_slots_count : 0;
+
+		/*
+			Orders against the previous step, or the last step
+			of the previous frame submitted to the same queue.
+		*/
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "physics_barrier");
+
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			_physics_pipeline_layout, 0, 1,
+			frame->physics_descriptor_sets + ((_particle_state_idx + i) & 1), 0, NULL
+		);
+		vkCmdPushConstants(
+			command_buffer,
+			_physics_pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0, sizeof(PhysicsConstants), &physics_constants
+		);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _step_arguments_pipeline);
+		vkCmdDispatch(command_buffer, 1, 1, 1);
+
+		mark_gpu_pass(command_buffer, "step_arguments");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "physics_barrier");
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _emit_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, emit_dispatch));
+
+		mark_gpu_pass(command_buffer, "emit");
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			barrier_stages, barrier_stages,
+			VK_FLAGS_NONE,
+			1, &memory_barrier, 0, NULL, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "physics_barrier");
+
+		if (_render_settings.physics.fluid.enabled)
+		{
+			_write_fluid_commands(command_buffer);
+		}
+
+		if (_render_settings.physics.nbody.solver != GRAVITY_SOLVER_NONE)
+		{
+			_write_gravity_commands(command_buffer);
+		}
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _physics_pipeline);
+		vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, physics_dispatch));
+
+		mark_gpu_pass(command_buffer, "physics");
+	}
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "physics_barrier");
+
+	/*
+		Frame passes read the state and alive list written by the last step.
+		Visible particles are compacted into the particle buffer of the frame,
+		draw arguments are sized by their count.
+	*/
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_frame_pass_pipeline_layout, 0, 1,
+		frame->physics_descriptor_sets + ((_particle_state_idx + steps_count) & 1), 0, NULL
+	);
+	vkCmdPushConstants(
+		command_buffer,
+		_frame_pass_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(FrameConstants), &_frame_constants
+	);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_arguments_pipeline);
+	vkCmdDispatch(command_buffer, 1, 1, 1);
+
+	mark_gpu_pass(command_buffer, "cull_arguments");
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "frame_barrier");
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+	vkCmdDispatchIndirect(command_buffer, _particle_counters_buffer, offsetof(ParticleCounters, cull_dispatch));
+
+	mark_gpu_pass(command_buffer, "cull");
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barrier_stages, barrier_stages,
+		VK_FLAGS_NONE,
+		1, &memory_barrier, 0, NULL, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "frame_barrier");
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _draw_arguments_pipeline);
+	vkCmdDispatch(command_buffer, 1, 1, 1);
+
+	mark_gpu_pass(command_buffer, "draw_arguments");
+
+	if (_render_settings.blend_particles)
+	{
+		_write_sort_commands(command_buffer, frame);
+	}
+}
+static bool _write_compute_command_buffer(uint32_t frame_idx)
+{
+	FrameResources *frame = _frames.data + frame_idx;
+	VkCommandBuffer command_buffer = _command_buffers.data[_compute_command_buffers_begin_idx + frame_idx];
+
+	VkCommandBufferBeginInfo beginInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+
+	PROCESS_VK_RESULT(
+		vkBeginCommandBuffer(
+			command_buffer,
+			&beginInfo
+		)
+	);
+
+	/*
+		Queries of the graphics timeline are reset here as well,
+		the graphics submit runs after this one.
+	*/
+	begin_gpu_profiler_frame(command_buffer, frame_idx);
+	begin_gpu_timeline(command_buffer, "compute");
+
+	_write_physics_commands(command_buffer, frame);
+
+	/*
+		Other paths read particles of the frame in the graphics pass directly.
+	*/
+	if (_render_settings.render_path != RENDER_PATH_COMPUTE_EXPANDED)
+	{
+		VkBufferMemoryBarrier graphics_barriers[2] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.buffer = frame->particle_buffer,
+				.size = VK_WHOLE_SIZE,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+				.srcQueueFamilyIndex = _operation_queue_families.compute_family_idx,
+				.dstQueueFamilyIndex = _operation_queue_families.graphics_family_idx,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.buffer = frame->arguments_buffer,
+				.size = VK_WHOLE_SIZE,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+				.srcQueueFamilyIndex = _operation_queue_families.compute_family_idx,
+				.dstQueueFamilyIndex = _operation_queue_families.graphics_family_idx,
+			},
+		};
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			VK_FLAGS_NONE,
+			0, NULL, 2, graphics_barriers, 0, NULL
+		);
+
+		mark_gpu_pass(command_buffer, "frame_barrier");
+
+		return vkEndCommandBuffer(command_buffer) == VK_SUCCESS;
+	}
+
+	/*
+		Add memory barrier to ensure that the (graphics) vertex input stage
+		has fetched attributes before compute starts to write to the buffers.
+		Frame buffers were last read by the draw submitted frames_in_flight frames ago.
+	*/
+	VkBufferMemoryBarrier buffer_memory_barriers[3] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.buffer = frame->vertex_buffer,
+			.size = VK_WHOLE_SIZE,
+			.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,  // Vertex input has finished reading from the buffer
+			.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,           // Compute shader wants to write to the buffer
+			/*
+				Compute and graphics queue may have different queue families.
+				For the barrier to work across different queues,
+				we need to set their family indices.
+			*/
+			.srcQueueFamilyIndex = _operation_queue_families.graphics_family_idx,  // Required as compute and graphics queue may have different families
+			.dstQueueFamilyIndex = _operation_queue_families.compute_family_idx,    // Required as compute and graphics queue may have different families
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.buffer = frame->index_buffer,
+			.size = VK_WHOLE_SIZE,
+			.srcAccessMask = VK_ACCESS_INDEX_READ_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.srcQueueFamilyIndex = _operation_queue_families.graphics_family_idx,
+			.dstQueueFamilyIndex = _operation_queue_families.compute_family_idx,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.buffer = frame->arguments_buffer,
+			.size = VK_WHOLE_SIZE,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+			.srcQueueFamilyIndex = _operation_queue_families.compute_family_idx,
+			.dstQueueFamilyIndex = _operation_queue_families.graphics_family_idx,
+		},
+	};
+
+	/*
+		Expansion reads particles and its dispatch size written by the cull pass.
+	*/
+	VkMemoryBarrier particles_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_FLAGS_NONE,
+		1, &particles_barrier,
+		2, buffer_memory_barriers,
+		0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "frame_barrier");
+
+	vkCmdBindPipeline(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_compute_pipeline
+	);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		_compute_pipeline_layout, 0, 1, &(frame->descriptor_set), 0, NULL
+	);
+	vkCmdPushConstants(
+		command_buffer,
+		_compute_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(FrameConstants), &_frame_constants
+	);
+
+	// Dispatch the compute job, one invocation per alive particle
+	vkCmdDispatchIndirect(command_buffer, frame->arguments_buffer, offsetof(FrameArguments, expansion_dispatch));
+
+	mark_gpu_pass(command_buffer, "expand");
+
+	/*
+		Add memory barrier to ensure that compute shader has finished writing to the buffers.
+		Graphics submit of the same frame additionally waits on compute_finished semaphore.
+	*/
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		buffer_memory_barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		buffer_memory_barriers[i].srcQueueFamilyIndex = _operation_queue_families.compute_family_idx;
+		buffer_memory_barriers[i].dstQueueFamilyIndex = _operation_queue_families.graphics_family_idx;
+	}
+
+	buffer_memory_barriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	buffer_memory_barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_FLAGS_NONE,
+		0, NULL, 3, buffer_memory_barriers, 0, NULL
+	);
+
+	mark_gpu_pass(command_buffer, "frame_barrier");
 
-	VkWriteDescriptorSet uniform_data_write_descriptor_set = {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet = _descriptor_set,
-		.dstBinding = 2,
-		.dstArrayElement = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = 1,
-		.pBufferInfo = &mvp_buffer_info,
+	return vkEndCommandBuffer(command_buffer) == VK_SUCCESS;
+}
+static bool _create_frame_sync_objects()
+{
+	VkSemaphoreCreateInfo semaphore_ci = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
 	};
 
-	VkWriteDescriptorSet particle_write_descriptor_set = {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet = _descriptor_set,
-		.dstBinding = 3,
-		.dstArrayElement = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 1,
-		.pBufferInfo = &particle_buffer_info,
+	/*
+		Fences start signaled so that the first wait on every frame returns immediately.
+	*/
+	VkFenceCreateInfo fence_ci = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
 	};
 
-	VkWriteDescriptorSet write_descriptor_sets[GPU_DATA_BINDINGS_COUNT] = {
-		vertex_write_descriptor_set,
-		index_write_descriptor_set,
-		uniform_data_write_descriptor_set,
-		particle_write_descriptor_set
-	};
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
 
-	vkUpdateDescriptorSets(_device, GPU_DATA_BINDINGS_COUNT, write_descriptor_sets, 0, NULL);
+		PROCESS_VK_RESULT(vkCreateSemaphore(_device, &semaphore_ci, NULL, &(frame->image_available)));
+		PROCESS_VK_RESULT(vkCreateSemaphore(_device, &semaphore_ci, NULL, &(frame->compute_finished)));
+		PROCESS_VK_RESULT(vkCreateSemaphore(_device, &semaphore_ci, NULL, &(frame->render_finished)));
+		PROCESS_VK_RESULT(vkCreateFence(_device, &fence_ci, NULL, &(frame->in_flight)));
+	}
 
 	return true;
 }
-static bool _create_uniform_data_buffer()
+/*
+	Called once the fence of frame_idx has been waited for,
+	GPU times go to the timings the frame was drawn for.
+*/
+static void _collect_frame_timings(uint32_t frame_idx)
 {
-	VkDeviceSize buffer_size = sizeof(UniformData);
-
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			&_host_uniform_data_buffer,
-			&_host_uniform_data_buffer_memory
-		)
-	);
-
-	void *data;
-
-	vkMapMemory(_device, _host_uniform_data_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, &_uniform_data, (uint32_t)buffer_size);
-	vkUnmapMemory(_device, _host_uniform_data_buffer_memory);
+	FrameResources *frame = _frames.data + frame_idx;
+	FrameTimings *timings = frame->timings;
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&_device_uniform_data_buffer,
-			&_device_uniform_data_buffer_memory
-		)
-	);
+	frame->timings = NULL;
 
-	return _copy_buffer(&_device_uniform_data_buffer, &_host_uniform_data_buffer, buffer_size);
+	if (collect_gpu_profiler_frame(frame_idx) && timings != NULL)
+	{
+		timings->gpu_compute_milliseconds = get_gpu_pass_milliseconds("compute");
+		timings->gpu_graphics_milliseconds = get_gpu_pass_milliseconds("graphics");
+	}
 }
-static bool _create_vertex_buffer()
+/*
+	Combined MVP is computed once per frame on CPU,
+	shaders get it through push constants.
+*/
+static void _update_frame_constants()
 {
-	VkDeviceSize buffer_size = sizeof(Vertex) * _vertices.count;
-
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			&_host_vertex_buffer,
-			&_host_vertex_buffer_memory
-		)
-	);
+	Matrix4x4 view_model = get_multiplied_m(&_view, &_model);
 
-	void* data;
-
-	vkMapMemory(_device, _host_vertex_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, _vertices.data, (uint32_t)buffer_size);
-	vkUnmapMemory(_device, _host_vertex_buffer_memory);
+	_frame_constants.mvp = get_multiplied_m(&_projection, &view_model);
+}
+static double _get_time()
+{
+	struct timespec time;
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&_device_vertex_buffer,
-			&_device_vertex_buffer_memory
-		)
-	);
+	clock_gettime(CLOCK_MONOTONIC, &time);
 
-	return _copy_buffer(&_device_vertex_buffer, &_host_vertex_buffer, buffer_size);
+	return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
 }
-static bool _create_index_buffer()
+/*
+	Fixed steps covered by the time elapsed since the previous frame.
+*/
+static void _update_physics_steps()
 {
-	VkDeviceSize buffer_size = sizeof(uint32_t) * _indices.count;
+	double time_step = (double)_render_settings.physics.time_step;
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			&_host_index_buffer,
-			&_host_index_buffer_memory
-		)
-	);
+	/*
+		Headless runs step the same way whatever the speed of the device.
+	*/
+	double time = _render_settings.headless.enabled ? _physics_time + time_step : _get_time();
 
-	void* data;
+	_physics_time_accumulator += time - _physics_time;
+	_physics_time = time;
 
-	vkMapMemory(_device, _host_index_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, _indices.data, (uint32_t)buffer_size);
-	vkUnmapMemory(_device, _host_index_buffer_memory);
+	_physics_constants.seed += _physics_steps_count > 0 ? _physics_steps_count : 1;
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&_device_index_buffer,
-			&_device_index_buffer_memory
-		)
-	);
+	_physics_steps_count = (uint32_t)(_physics_time_accumulator / time_step);
+
+	if (_physics_steps_count > _render_settings.physics.max_steps_per_frame)
+	{
+		_physics_steps_count = _render_settings.physics.max_steps_per_frame;
+		_physics_time_accumulator = 0.0;
+	}
+	else
+	{
+		_physics_time_accumulator -= _physics_steps_count * time_step;
+	}
+
+	/*
+		Fractions of a particle carry over to the next frames.
+	*/
+	_physics_emission_accumulator += _render_settings.physics.emission_rate * time_step * _physics_steps_count;
+	_physics_emit_count = (uint32_t)_physics_emission_accumulator;
+	_physics_emission_accumulator -= _physics_emit_count;
 
-	return _copy_buffer(&_device_index_buffer, &_host_index_buffer, buffer_size);
+	if (_physics_emit_count > _physics_constants.particle_capacity)
+	{
+		_physics_emit_count = _physics_constants.particle_capacity;
+	}
 }
-static bool _create_particle_buffer()
+/*
+	Moves resources of the current swap chain into resources,
+	current handles are left empty.
+*/
+static void _take_swap_chain_resources(RetiredSwapChain *resources)
+{
+	resources->swap_chain = _swap_chain;
+	resources->images = _swap_chain_images;
+	resources->image_views = _swap_chain_image_views;
+	resources->framebuffers = _swap_chain_framebuffers;
+	resources->depth_image = _depth_image;
+	resources->depth_image_view = _depth_image_view;
+	resources->depth_image_memory = _depth_image_memory;
+
+	_swap_chain = VK_NULL_HANDLE;
+	memset(&_swap_chain_images, 0, sizeof(_swap_chain_images));
+	memset(&_swap_chain_image_views, 0, sizeof(_swap_chain_image_views));
+	memset(&_swap_chain_framebuffers, 0, sizeof(_swap_chain_framebuffers));
+	_depth_image = VK_NULL_HANDLE;
+	_depth_image_view = VK_NULL_HANDLE;
+	memset(&_depth_image_memory, 0, sizeof(_depth_image_memory));
+}
+static void _destroy_swap_chain_resources(RetiredSwapChain *resources)
 {
-	VkDeviceSize buffer_size = sizeof(Particle) * _particles.count;
+	for (uint32_t i = 0; i < resources->framebuffers.count; i += 1)
+	{
+		vkDestroyFramebuffer(_device, resources->framebuffers.data[i], NULL);
+	}
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			&_host_particle_buffer,
-			&_host_particle_buffer_memory
-		)
-	);
+	free(resources->framebuffers.data);
 
-	void* data;
+	vkDestroyImageView(_device, resources->depth_image_view, NULL);
+	vkDestroyImage(_device, resources->depth_image, NULL);
+	free_device_memory(&(resources->depth_image_memory));
 
-	vkMapMemory(_device, _host_particle_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, _particles.data, (uint32_t)buffer_size);
-	vkUnmapMemory(_device, _host_particle_buffer_memory);
+	for (uint32_t i = 0; i < resources->image_views.count; i += 1)
+	{
+		vkDestroyImageView(_device, resources->image_views.data[i], NULL);
+	}
 
-	PROCESS_RESULT(
-		_create_memory_buffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&_device_particle_buffer,
-			&_device_particle_buffer_memory
-		)
-	);
+	free(resources->image_views.data);
+	free(resources->images.data);
 
-	return _copy_buffer(&_device_particle_buffer, &_host_particle_buffer, buffer_size);
+	/*
+		Headless devices are created without the swap chain extension.
+	*/
+	if (resources->swap_chain != VK_NULL_HANDLE)
+	{
+		vkDestroySwapchainKHR(_device, resources->swap_chain, NULL);
+	}
 }
-static bool _create_framebuffers()
+/*
+	Called once the fence of frame_idx has been waited for.
+*/
+static void _release_retired_swap_chains(uint32_t frame_idx)
 {
-	_swap_chain_framebuffers.count = _swap_chain_image_views.count;
-	_swap_chain_framebuffers.data = malloc(sizeof(SwapChainFramebuffers) * _swap_chain_framebuffers.count);
+	uint32_t kept_count = 0;
 
-	for (uint32_t i = 0; i < _swap_chain_framebuffers.count; i++)
+	for (uint32_t i = 0; i < _retired_swap_chains_count; i += 1)
 	{
-		VkImageView attachments[2] = {
-			_swap_chain_image_views.data[i],
-			_depth_image_view
-		};
+		RetiredSwapChain *retired = _retired_swap_chains + i;
 
-		VkFramebufferCreateInfo framebufferInfo = {
-			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-			.renderPass = _render_pass,
-			.attachmentCount = 2,
-			.pAttachments = attachments,
-			.width = _swap_chain_image_extent.width,
-			.height = _swap_chain_image_extent.height,
-			.layers = 1,
-		};
+		retired->pending_frames_mask &= ~(1u << frame_idx);
 
-		PROCESS_VK_RESULT(vkCreateFramebuffer(_device, &framebufferInfo, NULL, _swap_chain_framebuffers.data + i));
+		if (retired->pending_frames_mask == 0)
+		{
+			_destroy_swap_chain_resources(retired);
+		}
+		else
+		{
+			_retired_swap_chains[kept_count] = *retired;
+			kept_count += 1;
+		}
 	}
 
-	return true;
+	_retired_swap_chains_count = kept_count;
 }
-static bool _allocate_image_draw_command_buffers()
+/*
+	Render pass, pipelines and command buffers do not depend on the swap chain
+	size, only the swap chain, depth image and framebuffers are created again.
+	The old ones are retired instead of waiting for the device,
+	the new swap chain takes presentation over through oldSwapchain.
+	Called right after the fence of the current frame has been waited for.
+*/
+static bool _recreate_swap_chain()
 {
-	VkCommandBufferAllocateInfo image_draw_cb_ai = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = _long_live_buffers_pool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = _swap_chain_images.count,
-	};
+	_pick_swap_chain_image_extent();
 
-	return vkAllocateCommandBuffers(_device, &image_draw_cb_ai, _command_buffers.data + 1) == VK_SUCCESS;
-}
-static bool _allocate_compute_command_buffer()
-{
-	VkCommandBufferAllocateInfo compute_cb_ai = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = _long_live_buffers_pool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
-	};
+	/*
+		Minimized window, recreation stays requested.
+	*/
+	if (_swap_chain_image_extent.width == 0 || _swap_chain_image_extent.height == 0)
+	{
+		return true;
+	}
 
-	return vkAllocateCommandBuffers(_device, &compute_cb_ai, _command_buffers.data + 1 + _swap_chain_images.count) == VK_SUCCESS;
-}
-static bool _create_command_pools_and_allocate_buffers()
-{
-	VkCommandPoolCreateInfo long_live_buffers_pool_ci = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // _operation_queue_families.use_same_family == true
-	};
+	/*
+		Burst of resizes faster than frames complete.
+	*/
+	if (_retired_swap_chains_count == MAX_RETIRED_SWAP_CHAINS)
+	{
+		PROCESS_VK_RESULT(vkDeviceWaitIdle(_device));
 
-	VkCommandPoolCreateInfo one_time_buffers_pool_ci = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.queueFamilyIndex = _operation_queue_families.graphics_family_idx,  // _operation_queue_families.use_same_family == true
-		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-	};
+		for (uint32_t i = 0; i < _retired_swap_chains_count; i += 1)
+		{
+			_destroy_swap_chain_resources(_retired_swap_chains + i);
+		}
 
-	_one_time_command_buffer_idx = 0;
-	_image_draw_command_buffers_begin_idx = 1;
-	_compute_command_buffer_idx = _image_draw_command_buffers_begin_idx + _swap_chain_images.count;
+		_retired_swap_chains_count = 0;
+	}
 
-	_command_buffers.count = 2 + _swap_chain_images.count;
-	_command_buffers.data = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * _command_buffers.count);
+	RetiredSwapChain *retired = _retired_swap_chains + _retired_swap_chains_count;
+	_retired_swap_chains_count += 1;
 
-	PROCESS_VK_RESULT(vkCreateCommandPool(_device, &long_live_buffers_pool_ci, NULL, &_long_live_buffers_pool));
-	PROCESS_VK_RESULT(vkCreateCommandPool(_device, &one_time_buffers_pool_ci, NULL, &_one_time_buffers_pool));
+	_take_swap_chain_resources(retired);
 
-	VkCommandBufferAllocateInfo one_time_buffer_ai = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = _one_time_buffers_pool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
-	};
+	retired->pending_frames_mask = (_frames.count < 32 ? (1u << _frames.count) - 1 : UINT32_MAX) & ~(1u << _frame_idx);
+
+	_swap_chain_resize_requested = false;
 
 	return (
-		vkAllocateCommandBuffers(_device, &one_time_buffer_ai, _command_buffers.data) == VK_SUCCESS &&
-		_allocate_image_draw_command_buffers() &&
-		_allocate_compute_command_buffer()
+		_create_swap_chain(retired->swap_chain) &&
+		_create_depth_resources() &&
+		_create_framebuffers()
 	);
 }
-static bool _write_image_draw_command_buffers()
+/*
+	Acquired is false when no image could be acquired
+	and the frame is skipped, the swap chain is recreated first if needed.
+*/
+static bool _acquire_swap_chain_image(FrameResources *frame, uint32_t *image_index, bool *acquired)
 {
-	for (uint32_t i = 0; i < _swap_chain_images.count; i++)
-	{
-		uint32_t idx = _image_draw_command_buffers_begin_idx + i;
-
-		VkCommandBufferBeginInfo beginInfo = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-			.pInheritanceInfo = NULL, // Optional
-		};
-		vkBeginCommandBuffer(_command_buffers.data[idx], &beginInfo);
-
-		VkRenderPassBeginInfo renderPassInfo = {
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = _render_pass,
-			.framebuffer = _swap_chain_framebuffers.data[i],
-			.renderArea.offset = { 0, 0 },
-			.renderArea.extent = _swap_chain_image_extent,
-		};
-
-		VkClearValue clearValues[2];
-		VkClearColorValue clear_color = {
-			.float32 = { 0.0f, 0.0f, 0.0f, 0.0f },
-		};
-		VkClearDepthStencilValue clear_depth_stencil = {
-			.depth = 1.0f,
-			.stencil = 0,
-		};
-		clearValues[0].color = clear_color;
-		clearValues[1].depthStencil = clear_depth_stencil;
+	*acquired = false;
 
-		renderPassInfo.clearValueCount = 2;
-		renderPassInfo.pClearValues = clearValues;
+	if (_swap_chain_resize_requested)
+	{
+		PROCESS_RESULT(_recreate_swap_chain());
 
-		vkCmdBeginRenderPass(_command_buffers.data[idx], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (_swap_chain_resize_requested)
+		{
+			/*
+				Nothing to present into while minimized.
+			*/
+			glfwWaitEvents();
 
-		vkCmdBindPipeline(_command_buffers.data[idx], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
+			return true;
+		}
+	}
 
-		VkDeviceSize offsets[] = { 0 };
+	VkResult acquire_result = vkAcquireNextImageKHR(
+		_device,
+		_swap_chain,
+		UINT64_MAX,
+		frame->image_available,
+		VK_NULL_HANDLE,
+		image_index
+	);
 
-		vkCmdBindDescriptorSets(
-			_command_buffers.data[idx],
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			_graphics_pipeline_layout, 0, 1,
-			&_descriptor_set, 0, NULL
-		);
+	if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		_swap_chain_resize_requested = true;
 
-		vkCmdBindVertexBuffers(_command_buffers.data[idx], 0, 1, &_device_vertex_buffer, offsets);
-		vkCmdBindIndexBuffer(_command_buffers.data[idx], _device_index_buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(_command_buffers.data[idx], _indices.count, 1, 0, 0, 0);
-		vkCmdEndRenderPass(_command_buffers.data[idx]);
+		return true;
+	}
 
-		PROCESS_VK_RESULT(vkEndCommandBuffer(_command_buffers.data[idx]));
+	if (acquire_result != VK_SUBOPTIMAL_KHR)
+	{
+		PROCESS_VK_RESULT(acquire_result);
 	}
 
+	*acquired = true;
+
 	return true;
 }
-static bool _write_compute_command_buffer()
+/*
+	Host only waits for the frame which used the same resources
+	frames_in_flight frames ago, so recording of this frame overlaps
+	GPU execution of the previous ones.
+	Graphics waits for compute with a semaphore, never on host.
+	Physics runs in the compute submit on every render path.
+	Command buffers of the frame are recorded again as push constants
+	change every frame, the fence guarantees they are not pending.
+	Out of date swap chains are recreated between frames, a frame whose
+	image cannot be acquired is skipped, suboptimal ones are still presented.
+	Headless frames draw into the offscreen image and present nothing.
+*/
+static bool _draw_frame()
 {
-	VkCommandBufferBeginInfo beginInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-	};
+	FrameResources *frame = _frames.data + _frame_idx;
 
-	PROCESS_VK_RESULT(
-		vkBeginCommandBuffer(
-			_command_buffers.data[_compute_command_buffer_idx],
-			&beginInfo
-		)
-	);
+	PROCESS_VK_RESULT(vkWaitForFences(_device, 1, &(frame->in_flight), VK_TRUE, UINT64_MAX));
 
-	/*
-		Add memory barrier to ensure that the (graphics) vertex shader
-		has fetched attributes before compute starts to write to the buffer.
-	*/
-	VkBufferMemoryBarrier bufferMemoryBarrier = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-		.buffer = _device_particle_buffer,
-		.size = VK_WHOLE_SIZE,
-		.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,  // Vertex shader invocations have finished reading from the buffer
-		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,           // Compute shader wants to write to the buffer
-		/*
-			Compute and graphics queue may have different queue families.
-			For the barrier to work across different queues,
-			we need to set their family indices.
-		*/
-		.srcQueueFamilyIndex = _operation_queue_families.graphics_family_idx,  // Required as compute and graphics queue may have different families
-		.dstQueueFamilyIndex = _operation_queue_families.compute_family_idx,    // Required as compute and graphics queue may have different families
-	};
+	_collect_frame_timings(_frame_idx);
+	_release_retired_swap_chains(_frame_idx);
 
-	vkCmdPipelineBarrier(
-		_command_buffers.data[_compute_command_buffer_idx],
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_FLAGS_NONE,
-		0, NULL,
-		1, &bufferMemoryBarrier,
-		0, NULL
-	);
+	bool headless = _render_settings.headless.enabled;
+	uint32_t image_index = 0;
 
-	vkCmdBindPipeline(
-		_command_buffers.data[_compute_command_buffer_idx],
-		VK_PIPELINE_BIND_POINT_COMPUTE,
-		_compute_pipeline
-	);
-	vkCmdBindDescriptorSets(
-		_command_buffers.data[_compute_command_buffer_idx],
-		VK_PIPELINE_BIND_POINT_COMPUTE,
-		_compute_pipeline_layout, 0, 1, &_descriptor_set, 0, 0
-	);
+	if (!headless)
+	{
+		bool acquired;
+
+		PROCESS_RESULT(_acquire_swap_chain_image(frame, &image_index, &acquired));
 
-	// Dispatch the compute job
-	vkCmdDispatch(_command_buffers.data[_compute_command_buffer_idx], PARTICLE_COUNT, 1, 1);
+		if (!acquired)
+		{
+			return true;
+		}
+	}
 
-	// Add memory barrier to ensure that compute shader has finished writing to the buffer
-	// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame) 
-	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;          // Compute shader has finished writes to the buffer
-	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT; // Vertex shader invocations want to read from the buffer
-	bufferMemoryBarrier.buffer = _device_particle_buffer;
-	bufferMemoryBarrier.size = VK_WHOLE_SIZE;
-	bufferMemoryBarrier.srcQueueFamilyIndex = _operation_queue_families.compute_family_idx;
-	bufferMemoryBarrier.dstQueueFamilyIndex = _operation_queue_families.graphics_family_idx;
+	PROCESS_VK_RESULT(vkResetFences(_device, 1, &(frame->in_flight)));
 
-	vkCmdPipelineBarrier(
-		_command_buffers.data[_compute_command_buffer_idx],
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
-		VK_FLAGS_NONE,
-		0, NULL, 1, &bufferMemoryBarrier, 0, NULL
-	);
+	_update_frame_constants();
+	_update_physics_steps();
 
-	return vkEndCommandBuffer(_command_buffers.data[_compute_command_buffer_idx]) == VK_SUCCESS;
-}
-static bool _create_semaphores()
-{
-	VkSemaphoreCreateInfo semaphore_ci = {
-		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
-	};
+	PROCESS_RESULT(_upload_spawned_particles(frame));
 
-	return (
-		vkCreateSemaphore(_device, &semaphore_ci, NULL, &_image_available) == VK_SUCCESS &&
-		vkCreateSemaphore(_device, &semaphore_ci, NULL, &_render_finished) == VK_SUCCESS
-	);
-}
-static bool _create_compute_finished_fence()
-{
-	VkFenceCreateInfo fence_ci = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-	};
+	PROCESS_RESULT(_write_compute_command_buffer(_frame_idx));
+	PROCESS_RESULT(_write_image_draw_command_buffer(_frame_idx, image_index));
 
-	return vkCreateFence(_device, &fence_ci, NULL, &_compute_finished_fence) == VK_SUCCESS;
-}
-static bool _draw_frame()
-{
-	vkResetFences(_device, 1, &_compute_finished_fence);
+	_particle_state_idx = (_particle_state_idx + (_physics_steps_count > 0 ? _physics_steps_count : 1)) & 1;
+	_physics_added_slots_count = 0;
 
 	VkSubmitInfo compute_queue_submit_info = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 		.pNext = NULL,
 		.commandBufferCount = 1,
-		.pCommandBuffers = _command_buffers.data + _compute_command_buffer_idx,
+		.pCommandBuffers = _command_buffers.data + _compute_command_buffers_begin_idx + _frame_idx,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &(frame->compute_finished),
 	};
 
-	if (
-		vkQueueSubmit(
-			_compute_queue,
-			1,
-			&compute_queue_submit_info,
-			_compute_finished_fence
-		) != VK_SUCCESS
-	) {
-		return false;
-	}
+	PROCESS_VK_RESULT(vkQueueSubmit(_compute_queue, 1, &compute_queue_submit_info, VK_NULL_HANDLE));
 
-	uint32_t image_index;
+	VkSemaphore wait_semaphores[2] = {
+		frame->image_available,
+		frame->compute_finished,
+	};
 
-	if (
-		vkAcquireNextImageKHR(
-			_device,
-			_swap_chain,
-			1000,
-			_image_available,
-			VK_NULL_HANDLE,
-			&image_index
-		) != VK_SUCCESS
-	) {
-		return false;
-	}
+	VkPipelineStageFlags wait_dst_stage_flags[2] = {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+	};
 
-	VkFlags wait_dst_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	/*
+		Headless frames only wait for compute and signal nothing but the fence.
+	*/
+	uint32_t first_wait_semaphore = headless ? 1 : 0;
 
 	VkSubmitInfo graphics_queue_submit_info = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &_image_available,
-		.pWaitDstStageMask = &wait_dst_stage_flags,
+		.waitSemaphoreCount = 2 - first_wait_semaphore,
+		.pWaitSemaphores = wait_semaphores + first_wait_semaphore,
+		.pWaitDstStageMask = wait_dst_stage_flags + first_wait_semaphore,
 		.commandBufferCount = 1,
 		.pCommandBuffers = (
-			_command_buffers.data + _image_draw_command_buffers_begin_idx + image_index
+			_command_buffers.data + _get_image_draw_command_buffer_idx(_frame_idx)
 		),
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &_render_finished,
+		.signalSemaphoreCount = headless ? 0 : 1,
+		.pSignalSemaphores = &(frame->render_finished),
 	};
 
-	vkWaitForFences(_device, 1, &_compute_finished_fence, VK_TRUE, UINT64_MAX);
+	PROCESS_VK_RESULT(vkQueueSubmit(_graphics_queue, 1, &graphics_queue_submit_info, frame->in_flight));
+
+	frame->timings = _frame_timings;
 
-	if (vkQueueSubmit(_graphics_queue, 1, &graphics_queue_submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+	if (headless)
 	{
-		return false;
+		_frame_idx = (_frame_idx + 1) % _frames.count;
+
+		return true;
 	}
 
 	VkPresentInfoKHR presentInfo = {
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &_render_finished,
+		.pWaitSemaphores = &(frame->render_finished),
 		.swapchainCount = 1,
 		.pSwapchains = &_swap_chain,
 		.pImageIndices = &image_index,
 	};
 
-	return vkQueuePresentKHR(_present_queue, &presentInfo) == VK_SUCCESS;
-}
-static void _destroy_swap_chain()
-{
-	for (uint32_t i = 0; i < _swap_chain_framebuffers.count; i += 1)
+	_frame_idx = (_frame_idx + 1) % _frames.count;
+
+	VkResult present_result = vkQueuePresentKHR(_present_queue, &presentInfo);
+
+	if (present_result == VK_ERROR_OUT_OF_DATE_KHR || present_result == VK_SUBOPTIMAL_KHR)
 	{
-		vkDestroyFramebuffer(_device, _swap_chain_framebuffers.data[i], NULL);
+		_swap_chain_resize_requested = true;
+
+		return true;
 	}
 
-	free(_swap_chain_framebuffers.data);
+	return present_result == VK_SUCCESS;
+}
+/*
+	Model turns by the time the previous frame took,
+	headless frames by one time step.
+*/
+static bool _render_frame(float *time_diff)
+{
+	Vector3 rotation_axis = { .x = 1.0f, .y = 0.0f, .z = 0.0f };
+
+	clock_t t0 = clock();
+
+	Quaternion rotated = get_quaternion(((float)M_PI / 2.0f) * *time_diff, &rotation_axis);
+	_model_rotation = get_multiplied_q(&_model_rotation, &rotated);
+
+	_model = get_transform(&_model_rotation);
+
+	bool result = _draw_frame();
+
+	clock_t t1 = clock();
 
+	*time_diff = _render_settings.headless.enabled ? _render_settings.physics.time_step : (float)(t1 - t0) / CLOCKS_PER_SEC;
+
+	return result;
+}
+/*
+	Device must be idle, retired swap chains go as well.
+*/
+static void _destroy_swap_chain()
+{
 	vkFreeCommandBuffers(
 		_device,
 		_long_live_buffers_pool,
-		_swap_chain_images.count,
+		_frames.count,
 		_command_buffers.data + _image_draw_command_buffers_begin_idx
 	);
 
@@ -1807,73 +4878,91 @@ static void _destroy_swap_chain()
 	vkDestroyPipelineLayout(_device, _graphics_pipeline_layout, NULL);
 	vkDestroyRenderPass(_device, _render_pass, NULL);
 
-	vkDestroyImageView(_device, _depth_image_view, NULL);
-	vkDestroyImage(_device, _depth_image, NULL);
-	vkFreeMemory(_device, _depth_image_memory, NULL);
-
-	for (uint32_t i = 0; i < _swap_chain_image_views.count; i += 1)
+	for (uint32_t i = 0; i < _retired_swap_chains_count; i += 1)
 	{
-		vkDestroyImageView(_device, _swap_chain_image_views.data[i], NULL);
+		_destroy_swap_chain_resources(_retired_swap_chains + i);
 	}
 
-	free(_swap_chain_image_views.data);
-	free(_swap_chain_images.data);
+	_retired_swap_chains_count = 0;
 
-	vkDestroySwapchainKHR(_device, _swap_chain, NULL);
+	RetiredSwapChain current;
+	_take_swap_chain_resources(&current);
+	_destroy_swap_chain_resources(&current);
+
+	vkDestroyImage(_device, _offscreen_image, NULL);
+	free_device_memory(&_offscreen_image_memory);
+
+	_offscreen_image = VK_NULL_HANDLE;
 }
 static void _window_resize_callback(GLFWwindow* window, int width, int height)
 {
-	vkDeviceWaitIdle(_device);
-
-	_destroy_swap_chain();
-
-	_swap_chain_image_extent.width = width;
-	_swap_chain_image_extent.height = height;
-
-	if (!
-		(
-			_create_swap_chain() &&
-			_create_depth_resources() &&
-			_create_render_pass() &&
-			_create_graphics_pipeline() &&
-			_create_framebuffers() &&
-			_allocate_image_draw_command_buffers() &&
-			_write_image_draw_command_buffers()
-		)
-	) {
-		printf("Failed to resize window.\n");
-
-		glfwSetWindowShouldClose(_window, true);
-	}
+	_swap_chain_resize_requested = true;
 }
+/*
+	Spawns a particle under the cursor on the z = 0 plane of the model.
+
+	Model point (u, v, 0, 1) lands on the cursor when its clip coordinates
+	divided by w give the cursor NDC, two linear equations in u and v over
+	the columns of the MVP of the last frame. Same as intersecting the
+	unprojected cursor ray with the plane, without inverting the MVP.
+*/
 static void _mouse_button_callback(GLFWwindow *window, int mouse_button, int action, int mods)
 {
 	if (mouse_button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
 	{
 		double x, y;
+		int width, height;
 
 		glfwGetCursorPos(window, &x, &y);
+		glfwGetWindowSize(window, &width, &height);
+
+		if (width == 0 || height == 0)
+		{
+			return;
+		}
 
-		Particle *data_backup = _particles.data;
+		float ndc_x = (float)(2.0 * x / width - 1.0);
+		float ndc_y = (float)(2.0 * y / height - 1.0);
 
-		_particles.data = realloc(_particles.data, (_particles.count + 1) * sizeof(Particle));
+		const float *mvp = _frame_constants.mvp.data;
 
-		if (NULL == _particles.data)
+		float a00 = mvp[0] - ndc_x * mvp[3];
+		float a01 = mvp[4] - ndc_x * mvp[7];
+		float a10 = mvp[1] - ndc_y * mvp[3];
+		float a11 = mvp[5] - ndc_y * mvp[7];
+		float b0 = ndc_x * mvp[15] - mvp[12];
+		float b1 = ndc_y * mvp[15] - mvp[13];
+
+		float determinant = a00 * a11 - a01 * a10;
+
+		/*
+			Plane seen edge on, the cursor ray never crosses it once.
+		*/
+		if (fabsf(determinant) < 1e-6f)
 		{
-			printf("Failed to relocate particles' data.");
+			return;
+		}
 
-			_particles.data = data_backup;
+		float u = (b0 * a11 - a01 * b1) / determinant;
+		float v = (a00 * b1 - b0 * a10) / determinant;
+
+		/*
+			Intersection behind the camera.
+		*/
+		if (mvp[3] * u + mvp[7] * v + mvp[15] <= 0.0f)
+		{
 			return;
 		}
 
 		Particle new_particle = {
-			.position = { (float)x, (float)y, 0.0f, 1.0f },
+			.position = { u, v, 0.0f, 1.0f },
 			.color = { 1.0f, 1.0f, 1.0f, 1.0f },
 		};
 
-		_particles.data[_particles.count] = new_particle;
-
-		_particles.count += 1;
+		if (!spawn_particles(&new_particle, 1))
+		{
+			printf("Failed to spawn particle.\n");
+		}
 	}
 }
 static bool _init_window()
@@ -1889,24 +4978,9 @@ static bool _init_window()
 	}
 
 	glfwSetWindowSizeCallback(_window, _window_resize_callback);
-/*
-	callback is not properly implemented
-
 	glfwSetMouseButtonCallback(_window, _mouse_button_callback);
-*/
-	return true;
-}
-static bool _update_uniform_data_buffer()
-{
-	VkDeviceSize buffer_size = sizeof(UniformData);
-
-	void *data;
 
-	vkMapMemory(_device, _host_uniform_data_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, &_uniform_data, (uint32_t)buffer_size);
-	vkUnmapMemory(_device, _host_uniform_data_buffer_memory);
-
-	return _copy_buffer(&_device_uniform_data_buffer, &_host_uniform_data_buffer, buffer_size);
+	return true;
 }
 static void _glfw_error_callback(int glfw_errno, const char* error_description)
 {
@@ -1915,11 +4989,69 @@ static void _glfw_error_callback(int glfw_errno, const char* error_description)
 
 /* Module interface */
 
-bool setup_window_and_gpu()
+bool setup_window_and_gpu(const RenderSettings *settings)
 {
+	PROCESS_RESULT(settings->frames_in_flight > 0 && settings->frames_in_flight <= MAX_FRAMES_IN_FLIGHT);
+
+	_render_settings = *settings;
+
+	_physics_constants.gravity.x = settings->physics.gravity.x;
+	_physics_constants.gravity.y = settings->physics.gravity.y;
+	_physics_constants.gravity.z = settings->physics.gravity.z;
+	_physics_constants.drag = settings->physics.drag;
+	_physics_constants.time_step = settings->physics.time_step;
+	_physics_constants.emitter_position.x = settings->physics.emitter_position.x;
+	_physics_constants.emitter_position.y = settings->physics.emitter_position.y;
+	_physics_constants.emitter_position.z = settings->physics.emitter_position.z;
+	_physics_constants.emitter_position.w = 1.0f;
+	_physics_constants.emission_color = settings->physics.emission_color;
+	_physics_constants.emission_speed = settings->physics.emission_speed;
+	_physics_constants.particle_life_time = settings->physics.particle_life_time;
+	_physics_constants.gravity_strength = settings->physics.nbody.gravitational_constant * settings->physics.nbody.particle_mass;
+	_physics_constants.softening_squared = settings->physics.nbody.softening * settings->physics.nbody.softening;
+	_physics_constants.opening_angle_squared = settings->physics.nbody.opening_angle * settings->physics.nbody.opening_angle;
+	_physics_constants.particle_capacity = (
+		settings->physics.particle_capacity > _particles.count ? settings->physics.particle_capacity : _particles.count
+	);
+
+	if (_physics_constants.particle_capacity == 0)
+	{
+		_physics_constants.particle_capacity = 1;
+	}
+
+	_spawn_buffer_capacity = DEFAULT_SPAWN_BUFFER_CAPACITY;
+
+	PROCESS_RESULT(settings->physics.time_step > 0.0f);
+	PROCESS_RESULT(settings->physics.nbody.solver == GRAVITY_SOLVER_NONE || settings->physics.nbody.softening > 0.0f);
+
+	float bounds_min[3] = { settings->particle_bounds_min.x, settings->particle_bounds_min.y, settings->particle_bounds_min.z };
+	float bounds_max[3] = { settings->particle_bounds_max.x, settings->particle_bounds_max.y, settings->particle_bounds_max.z };
+
+	for (uint32_t i = 0; i < 3; i += 1)
+	{
+		_frame_constants.position_origin[i] = 0.0f;
+		_frame_constants.position_scale[i] = 1.0f;
+
+		if (settings->particle_format == PARTICLE_FORMAT_UNORM16)
+		{
+			PROCESS_RESULT(bounds_max[i] > bounds_min[i]);
+
+			_frame_constants.position_origin[i] = bounds_min[i];
+			_frame_constants.position_scale[i] = bounds_max[i] - bounds_min[i];
+		}
+	}
+
+	_frames.count = _render_settings.frames_in_flight;
+	_frames.data = (FrameResources *)calloc(_frames.count, sizeof(FrameResources));
+	_frame_idx = 0;
+
+	bool headless = _render_settings.headless.enabled;
+
+	PROCESS_RESULT(!headless || (_render_settings.headless.width > 0 && _render_settings.headless.height > 0));
+
 	glfwSetErrorCallback(_glfw_error_callback);
 
-	if (GLFW_TRUE != glfwInit()) return false;
+	if (!headless && GLFW_TRUE != glfwInit()) return false;
 
 	_setup_required_extensions();
 
@@ -1939,94 +5071,179 @@ bool setup_window_and_gpu()
 	PROCESS_RESULT(_setup_debug_callback());
 #endif
 
-	PROCESS_RESULT(_init_window());
-	PROCESS_VK_RESULT(glfwCreateWindowSurface(_instance, _window, NULL, &(_surface)))
+	if (!headless)
+	{
+		PROCESS_RESULT(_init_window());
+		PROCESS_VK_RESULT(glfwCreateWindowSurface(_instance, _window, NULL, &(_surface)))
+	}
 
+	/*
+		Swap chains are the only required device extension.
+	*/
 	_required_physical_device_extensions.names = (const char**)malloc(sizeof(const char*) * PHYSICAL_DEVICE_EXTENSIONS_COUNT);
 	_required_physical_device_extensions.names[0] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
-	_required_physical_device_extensions.count = PHYSICAL_DEVICE_EXTENSIONS_COUNT;
+	_required_physical_device_extensions.count = headless ? 0 : PHYSICAL_DEVICE_EXTENSIONS_COUNT;
 
 	PROCESS_RESULT(_pick_physical_device());
 	PROCESS_RESULT(_create_logical_device());
-	PROCESS_RESULT(_create_swap_chain());
+	PROCESS_RESULT(setup_device_memory(_physical_device, _device));
+	PROCESS_RESULT(setup_pipeline_cache(_physical_device, _device));
+	PROCESS_RESULT(
+		setup_upload_manager(
+			_device,
+			_transfer_queue,
+			(uint32_t)_operation_queue_families.transfer_family_idx,
+			_compute_queue,
+			(uint32_t)_operation_queue_families.compute_family_idx,
+			UPLOAD_STAGING_SIZE
+		)
+	);
+	if (headless)
+	{
+		PROCESS_RESULT(_create_offscreen_image());
+	}
+	else
+	{
+		_pick_swap_chain_image_extent();
+
+		PROCESS_RESULT(_create_swap_chain(VK_NULL_HANDLE));
+	}
 	PROCESS_RESULT(_create_command_pools_and_allocate_buffers());
 	PROCESS_RESULT(_create_depth_resources());
-	PROCESS_RESULT(_create_vertex_buffer());
-	PROCESS_RESULT(_create_index_buffer());
+	if (_render_settings.render_path == RENDER_PATH_COMPUTE_EXPANDED)
+	{
+		PROCESS_RESULT(_create_vertex_buffer());
+		PROCESS_RESULT(_create_index_buffer());
+	}
+
+	if (_render_settings.render_path == RENDER_PATH_INSTANCED)
+	{
+		PROCESS_RESULT(_create_quad_vertex_buffer());
+	}
+
 	PROCESS_RESULT(_create_particle_buffer());
-	PROCESS_RESULT(_create_uniform_data_buffer());
+	PROCESS_RESULT(_create_arguments_buffer());
+	PROCESS_RESULT(_create_spawn_buffer());
+	PROCESS_RESULT(_create_particle_state_buffers());
+	PROCESS_RESULT(_create_particle_list_buffers());
+	PROCESS_RESULT(_create_particle_counters_buffer());
+
+	if (_uses_radix_sort())
+	{
+		PROCESS_RESULT(_create_sort_buffers());
+	}
+
+	if (_render_settings.physics.nbody.solver == GRAVITY_SOLVER_TREE)
+	{
+		PROCESS_RESULT(_create_gravity_tree_buffers());
+	}
+
+	if (_render_settings.physics.fluid.enabled)
+	{
+		PROCESS_RESULT(_create_fluid_buffers());
+	}
+
+	PROCESS_RESULT(_upload_initial_particles());
+	PROCESS_RESULT(wait_uploads());
 	PROCESS_RESULT(_create_descriptor_pool());
 	PROCESS_RESULT(_create_descriptor_set_layout());
+	PROCESS_RESULT(_create_physics_descriptor_set_layout());
+	PROCESS_RESULT(_create_sort_descriptor_set_layout());
+	PROCESS_RESULT(_create_fluid_descriptor_set_layout());
+	PROCESS_RESULT(_create_gravity_tree_descriptor_set_layout());
 	PROCESS_RESULT(_create_descriptor_sets());
 	PROCESS_RESULT(_create_render_pass());
-	PROCESS_RESULT(_create_compute_pipeline());
-	PROCESS_RESULT(_create_compute_finished_fence());
+
+	/*
+		Compare runs with and without pipeline.cache for cold and warm startup.
+	*/
+	double pipelines_start_time = _get_time();
+
+	PROCESS_RESULT(_create_physics_pipeline());
+	PROCESS_RESULT(_create_frame_pass_pipelines());
+	if (_render_settings.render_path == RENDER_PATH_COMPUTE_EXPANDED)
+	{
+		PROCESS_RESULT(_create_compute_pipeline());
+	}
+
 	PROCESS_RESULT(_create_graphics_pipeline());
+
+	printf(
+		"Pipelines created in %.1f ms, %s pipeline cache.\n",
+		(_get_time() - pipelines_start_time) * 1000.0,
+		is_pipeline_cache_warm() ? "warm" : "cold"
+	);
+
 	PROCESS_RESULT(_create_framebuffers());
-	PROCESS_RESULT(_create_semaphores());
-	PROCESS_RESULT(_write_image_draw_command_buffers());
-	PROCESS_RESULT(_write_compute_command_buffer())
+	PROCESS_RESULT(_create_frame_sync_objects());
+	PROCESS_RESULT(
+		setup_gpu_profiler(
+			_physical_device,
+			_device,
+			(uint32_t)_operation_queue_families.graphics_family_idx,
+			_frames.count,
+			_render_settings.gpu_profiler_log_interval
+		)
+	);
 
 	return true;
 }
 void create_particles()
 {
-	_particles.data = (Particle*)malloc(sizeof(Particle) * PARTICLE_COUNT);
-	_particles.count = PARTICLE_COUNT;
+	Particle data[PARTICLE_COUNT];
 
 	Particle p0 = {
 		.position = { 0.5f, 0.5f, 0.0f, 1.0f },
 		.color = { 1.0f, 0.0f, 0.0f, 1.0f },
 	};
-	_particles.data[0] = p0;
+	data[0] = p0;
 
 	Particle p1 = {
 		.position = { 0.0f, 0.0f, 0.0f, 1.0f },
 		.color = { 0.0f, 1.0f, 0.0f, 1.0f },
 	};
-	_particles.data[1] = p1;
+	data[1] = p1;
 
 	Particle p2 = {
 		.position = { 0.5f, 0.0f, 0.0f, 1.0f },
 		.color = { 0.0f, 0.0f, 1.0f, 1.0f },
 	};
-	_particles.data[2] = p2;
+	data[2] = p2;
 
 	Particle p3 = {
 		.position = { 0.0f, 0.5f, 0.0f, 1.0f },
 		.color = { 0.5f, 0.5f, 0.5f, 1.0f },
 	};
-	_particles.data[3] = p3;
+	data[3] = p3;
 
 	Particle p4 = {
 		.position = { 0.5f, 0.5f, 0.5f, 1.0f },
 		.color = { 0.0f, 0.0f, 1.0f, 1.0f },
 	};
-	_particles.data[4] = p4;
+	data[4] = p4;
 
 	Particle p5 = {
 		.position = { 0.0f, 0.0f, 0.5f, 1.0f },
 		.color = { 0.0f, 0.0f, 1.0f, 1.0f },
 	};
-	_particles.data[5] = p5;
+	data[5] = p5;
 
 	Particle p6 = {
 		.position = { 0.5f, 0.0f, 0.5f, 1.0f },
 		.color = { 1.0f, 0.0f, 0.0f, 1.0f },
 	};
-	_particles.data[6] = p6;
+	data[6] = p6;
 
 	Particle p7 = {
 		.position = { 0.0f, 0.5f, 0.5f, 1.0f },
 		.color = { 0.5f, 0.5f, 0.5f, 1.0f },
 	};
-	_particles.data[7] = p7;
+	data[7] = p7;
 
-	_vertices.count = PARTICLE_COUNT * 4;
-	_vertices.data = (Vertex*)malloc(sizeof(Vertex) * _vertices.count);
-
-	_indices.count = PARTICLE_COUNT * 6;
-	_indices.data = (uint32_t*)malloc(sizeof(uint32_t) * _indices.count);
+	/*
+		No particles at start if the streams cannot be allocated.
+	*/
+	import_particles(&_particles, data, PARTICLE_COUNT);
 
 	update_perspective_projection_matrix(
 		&_projection,
@@ -2038,90 +5255,282 @@ void create_particles()
 
 	update_view_matrix(&_view, &_eye, &_look_at, &_up);
 
-	_uniform_data.model = _model;
-	_uniform_data.view = _view;
-	_uniform_data.projection = _projection;
+	_frame_constants.particle_radius = 0.08f;
 
-	_uniform_data.particle_count = PARTICLE_COUNT;
-	_uniform_data.particle_radius = 0.08f;
+	_update_frame_constants();
 }
 void destroy_particles()
 {
-	free(_particles.data);
-	free(_vertices.data);
-	free(_indices.data);
+	free_particles(&_particles);
+}
+void set_initial_particles(Particles *particles)
+{
+	free_particles(&_particles);
+
+	_particles = *particles;
+
+	particles->positions = NULL;
+	particles->colors = NULL;
+	particles->count = 0;
+}
+bool import_particles(Particles *particles, const Particle *data, uint32_t count)
+{
+	particles->positions = (Vector4 *)malloc(sizeof(Vector4) * count);
+	particles->colors = (Color *)malloc(sizeof(Color) * count);
+	particles->count = count;
+
+	if (count > 0 && (particles->positions == NULL || particles->colors == NULL))
+	{
+		free_particles(particles);
+
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		particles->positions[i] = data[i].position;
+		particles->colors[i] = data[i].color;
+	}
+
+	return true;
+}
+void export_particles(const Particles *particles, Particle *data)
+{
+	for (uint32_t i = 0; i < particles->count; i += 1)
+	{
+		data[i].position = particles->positions[i];
+		data[i].color = particles->colors[i];
+	}
+}
+void free_particles(Particles *particles)
+{
+	free(particles->positions);
+	free(particles->colors);
+
+	particles->positions = NULL;
+	particles->colors = NULL;
+	particles->count = 0;
 }
 void render()
 {
-	bool draw_success = true;
+	if (_render_settings.headless.enabled)
+	{
+		render_frames(_render_settings.headless.frame_count, NULL);
+
+		return;
+	}
 
-	clock_t t0, t1;
+	bool draw_success = true;
 	float time_diff = 0.0f;
-	Vector3 rotation_axis = { .x = 1.0f, .y = 0.0f, .z = 0.0f };
-	Quaternion base = { .x = 0.0f, .y = 0.0f, .z = 0.0f, .w = 1.0f };
+
+	_physics_time = _get_time();
+	_physics_time_accumulator = 0.0;
 
 	while (!glfwWindowShouldClose(_window) && draw_success)
 	{
 		glfwPollEvents();
 
-		t0 = clock();
+		draw_success = _render_frame(&time_diff);
+	}
 
-		Quaternion rotated = get_quaternion(((float)M_PI / 2.0f) * time_diff, &rotation_axis);
-		base = get_multiplied_q(&base, &rotated);
+	vkDeviceWaitIdle(_device);
+}
+bool render_frames(uint32_t frame_count, FrameTimings *timings)
+{
+	bool draw_success = true;
+	float time_diff = 0.0f;
 
-		_uniform_data.model = get_transform(&base);
+	_physics_time = _get_time();
+	_physics_time_accumulator = 0.0;
 
-		draw_success = (
-			_update_uniform_data_buffer() &&
-			_draw_frame()
-		);
+	for (uint32_t i = 0; i < frame_count && draw_success; i += 1)
+	{
+		if (!_render_settings.headless.enabled)
+		{
+			glfwPollEvents();
+		}
+
+		if (timings != NULL)
+		{
+			timings[i].gpu_compute_milliseconds = -1.0;
+			timings[i].gpu_graphics_milliseconds = -1.0;
+
+			_frame_timings = timings + i;
+		}
+
+		double start_time = _get_time();
+
+		draw_success = _render_frame(&time_diff);
 
-		t1 = clock();
+		if (timings != NULL)
+		{
+			timings[i].cpu_milliseconds = (_get_time() - start_time) * 1000.0;
+		}
+	}
+
+	_frame_timings = NULL;
 
-		time_diff = (float)(t1 - t0) / CLOCKS_PER_SEC;
+	bool result = vkDeviceWaitIdle(_device) == VK_SUCCESS && draw_success;
+
+	/*
+		Oldest frame first, the last collected one is the last drawn.
+	*/
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		_collect_frame_timings((_frame_idx + i) % _frames.count);
 	}
 
-	vkDeviceWaitIdle(_device);
+	return result;
+}
+void set_user_force(const Vector3 *force)
+{
+	_physics_constants.user_force.x = force->x;
+	_physics_constants.user_force.y = force->y;
+	_physics_constants.user_force.z = force->z;
+}
+bool spawn_particles(const Particle *particles, uint32_t count)
+{
+	uint64_t required_capacity = (uint64_t)_spawned_particles.count + count;
+
+	PROCESS_RESULT(required_capacity <= UINT32_MAX);
+
+	if (required_capacity > _spawned_particles.capacity)
+	{
+		uint32_t capacity = _spawned_particles.capacity > 0 ? _spawned_particles.capacity : DEFAULT_SPAWN_BUFFER_CAPACITY;
+
+		while (capacity < required_capacity)
+		{
+			capacity = capacity <= UINT32_MAX / 2 ? capacity * 2 : (uint32_t)required_capacity;
+		}
+
+		ParticleState *data = (ParticleState *)realloc(_spawned_particles.data, sizeof(ParticleState) * capacity);
+
+		PROCESS_RESULT(data != NULL);
+
+		_spawned_particles.data = data;
+		_spawned_particles.capacity = capacity;
+	}
+
+	for (uint32_t i = 0; i < count; i += 1)
+	{
+		ParticleState state = {
+			.position = particles[i].position,
+			.velocity = { 0.0f, 0.0f, 0.0f, INFINITY },
+			.color = particles[i].color,
+		};
+
+		_spawned_particles.data[_spawned_particles.count + i] = state;
+	}
+
+	_spawned_particles.count += count;
+
+	return true;
 }
 void destroy_window_and_free_gpu()
 {
 	vkDestroyDescriptorSetLayout(_device, _descriptor_set_layout, NULL);
+	vkDestroyDescriptorSetLayout(_device, _physics_descriptor_set_layout, NULL);
+	vkDestroyDescriptorSetLayout(_device, _sort_descriptor_set_layout, NULL);
+	vkDestroyDescriptorSetLayout(_device, _fluid_descriptor_set_layout, NULL);
+	vkDestroyDescriptorSetLayout(_device, _gravity_tree_descriptor_set_layout, NULL);
 	vkDestroyDescriptorPool(_device, _descriptor_pool, NULL);
 
-	vkDestroyBuffer(_device, _host_particle_buffer, NULL);
-	vkFreeMemory(_device, _host_particle_buffer_memory, NULL);
-	vkDestroyBuffer(_device, _device_particle_buffer, NULL);
-	vkFreeMemory(_device, _device_particle_buffer_memory, NULL);
+	for (uint32_t i = 0; i < 2; i += 1)
+	{
+		_destroy_memory_buffer(_alive_list_buffers + i, _alive_list_buffers_memory + i);
+	}
 
-	vkDestroyBuffer(_device, _host_uniform_data_buffer, NULL);
-	vkFreeMemory(_device, _host_uniform_data_buffer_memory, NULL);
-	vkDestroyBuffer(_device, _device_uniform_data_buffer, NULL);
-	vkFreeMemory(_device, _device_uniform_data_buffer_memory, NULL);
+	_destroy_particle_state_buffers();
 
-	vkDestroyBuffer(_device, _host_vertex_buffer, NULL);
-	vkFreeMemory(_device, _host_vertex_buffer_memory, NULL);
-	vkDestroyBuffer(_device, _device_vertex_buffer, NULL);
-	vkFreeMemory(_device, _device_vertex_buffer_memory, NULL);
+	_destroy_memory_buffer(&_dead_list_buffer, &_dead_list_buffer_memory);
+	_destroy_memory_buffer(&_particle_counters_buffer, &_particle_counters_buffer_memory);
+	_destroy_sort_buffers();
+	_destroy_fluid_buffers();
+	_destroy_gravity_tree_buffers();
 
-	vkDestroyBuffer(_device, _host_index_buffer, NULL);
-	vkFreeMemory(_device, _host_index_buffer_memory, NULL);
-	vkDestroyBuffer(_device, _device_index_buffer, NULL);
-	vkFreeMemory(_device, _device_index_buffer_memory, NULL);
+	_destroy_memory_buffer(&_quad_vertex_buffer, &_quad_vertex_buffer_memory);
 
-	vkDestroyFence(_device, _compute_finished_fence, NULL);
-	vkDestroySemaphore(_device, _image_available, NULL);
-	vkDestroySemaphore(_device, _render_finished, NULL);
+	for (uint32_t i = 0; i < _frames.count; i += 1)
+	{
+		FrameResources *frame = _frames.data + i;
+
+		_destroy_memory_buffer(&(frame->vertex_buffer), &(frame->vertex_buffer_memory));
+		_destroy_memory_buffer(&(frame->index_buffer), &(frame->index_buffer_memory));
+		_destroy_memory_buffer(&(frame->particle_buffer), &(frame->particle_buffer_memory));
+		_destroy_memory_buffer(&(frame->arguments_buffer), &(frame->arguments_buffer_memory));
+		_destroy_memory_buffer(&(frame->spawn_buffer), &(frame->spawn_buffer_memory));
+
+		vkDestroyFence(_device, frame->in_flight, NULL);
+		vkDestroySemaphore(_device, frame->image_available, NULL);
+		vkDestroySemaphore(_device, frame->compute_finished, NULL);
+		vkDestroySemaphore(_device, frame->render_finished, NULL);
+	}
 
 	vkDestroyShaderModule(_device, _vertex_shader, NULL);
 	vkDestroyShaderModule(_device, _fragment_shader, NULL);
 	vkDestroyShaderModule(_device, _compute_shader, NULL);
-
-	free(_vertex_shader_code);
-	free(_fragment_shader_code);
-	free(_compute_shader_code);
+	vkDestroyShaderModule(_device, _physics_shader, NULL);
+	vkDestroyShaderModule(_device, _emit_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_direct_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_arguments_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_bounds_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_morton_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_radix_histogram_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_radix_scan_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_radix_scatter_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_build_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_summarize_shader, NULL);
+	vkDestroyShaderModule(_device, _gravity_tree_forces_shader, NULL);
+	vkDestroyShaderModule(_device, _fluid_physics_shader, NULL);
+	vkDestroyShaderModule(_device, _grid_count_shader, NULL);
+	vkDestroyShaderModule(_device, _grid_scan_shader, NULL);
+	vkDestroyShaderModule(_device, _grid_scan_blocks_shader, NULL);
+	vkDestroyShaderModule(_device, _grid_scan_add_shader, NULL);
+	vkDestroyShaderModule(_device, _grid_scatter_shader, NULL);
+	vkDestroyShaderModule(_device, _sph_density_shader, NULL);
+	vkDestroyShaderModule(_device, _sph_forces_shader, NULL);
+	vkDestroyShaderModule(_device, _step_arguments_shader, NULL);
+	vkDestroyShaderModule(_device, _draw_arguments_shader, NULL);
+	vkDestroyShaderModule(_device, _cull_shader, NULL);
+	vkDestroyShaderModule(_device, _cull_arguments_shader, NULL);
+	vkDestroyShaderModule(_device, _sort_arguments_shader, NULL);
+	vkDestroyShaderModule(_device, _radix_histogram_shader, NULL);
+	vkDestroyShaderModule(_device, _radix_scan_shader, NULL);
+	vkDestroyShaderModule(_device, _radix_scatter_shader, NULL);
+	vkDestroyShaderModule(_device, _sort_gather_shader, NULL);
 
 	vkDestroyPipeline(_device, _compute_pipeline, NULL);
 	vkDestroyPipelineLayout(_device, _compute_pipeline_layout, NULL);
+	vkDestroyPipeline(_device, _physics_pipeline, NULL);
+	vkDestroyPipeline(_device, _emit_pipeline, NULL);
+	vkDestroyPipeline(_device, _step_arguments_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_direct_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_arguments_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_bounds_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_morton_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_radix_histogram_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_radix_scan_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_radix_scatter_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_build_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_summarize_pipeline, NULL);
+	vkDestroyPipeline(_device, _gravity_tree_forces_pipeline, NULL);
+	vkDestroyPipeline(_device, _grid_count_pipeline, NULL);
+	vkDestroyPipeline(_device, _grid_scan_pipeline, NULL);
+	vkDestroyPipeline(_device, _grid_scan_blocks_pipeline, NULL);
+	vkDestroyPipeline(_device, _grid_scan_add_pipeline, NULL);
+	vkDestroyPipeline(_device, _grid_scatter_pipeline, NULL);
+	vkDestroyPipeline(_device, _sph_density_pipeline, NULL);
+	vkDestroyPipeline(_device, _sph_forces_pipeline, NULL);
+	vkDestroyPipelineLayout(_device, _physics_pipeline_layout, NULL);
+	vkDestroyPipeline(_device, _cull_pipeline, NULL);
+	vkDestroyPipeline(_device, _cull_arguments_pipeline, NULL);
+	vkDestroyPipeline(_device, _draw_arguments_pipeline, NULL);
+	vkDestroyPipeline(_device, _sort_arguments_pipeline, NULL);
+	vkDestroyPipeline(_device, _radix_histogram_pipeline, NULL);
+	vkDestroyPipeline(_device, _radix_scan_pipeline, NULL);
+	vkDestroyPipeline(_device, _radix_scatter_pipeline, NULL);
+	vkDestroyPipeline(_device, _sort_gather_pipeline, NULL);
+	vkDestroyPipelineLayout(_device, _frame_pass_pipeline_layout, NULL);
 
 	vkFreeCommandBuffers(
 		_device,
@@ -2133,8 +5542,8 @@ void destroy_window_and_free_gpu()
 	vkFreeCommandBuffers(
 		_device,
 		_long_live_buffers_pool,
-		1,
-		_command_buffers.data + _compute_command_buffer_idx
+		_frames.count,
+		_command_buffers.data + _compute_command_buffers_begin_idx
 	);
 
 	_destroy_swap_chain();
@@ -2142,15 +5551,43 @@ void destroy_window_and_free_gpu()
 	vkDestroyCommandPool(_device, _long_live_buffers_pool, NULL);
 	vkDestroyCommandPool(_device, _one_time_buffers_pool, NULL);
 
+#ifdef _DEBUG
+	DeviceMemoryStats memory_stats;
+	get_device_memory_stats(&memory_stats);
+
+	printf(
+		"Device memory: %u blocks, %u dedicated, %u live allocations, %llu bytes reserved.\n",
+		memory_stats.block_count,
+		memory_stats.dedicated_allocation_count,
+		memory_stats.allocation_count,
+		(unsigned long long)memory_stats.reserved_bytes
+	);
+#endif
+
+	store_pipeline_cache();
+	clear_pipeline_cache();
+
+	clear_gpu_profiler();
+
+	clear_upload_manager();
+	clear_device_memory();
+
 	vkDestroyDevice(_device, NULL);
 
+	free(_command_buffers.data);
+	free(_frames.data);
+	free(_spawned_particles.data);
+
 	free(_surface_formats.data);
 	free(_present_modes.data);
 
 	free((void *)_required_instance_extensions.names);
 	free((void*)_required_physical_device_extensions.names);
 
-	vkDestroySurfaceKHR(_instance, _surface, NULL);
+	if (!_render_settings.headless.enabled)
+	{
+		vkDestroySurfaceKHR(_instance, _surface, NULL);
+	}
 
 #ifdef _DEBUG
 	free((void*)_required_validation_layers.names);
@@ -0,0 +1,577 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "upload_manager.h"
+#include "device_memory.h"
+
+#define UPLOAD_BATCHES_COUNT 4
+#define UPLOAD_ALIGNMENT 16
+
+typedef enum UploadBatchState
+{
+	UPLOAD_BATCH_IDLE,
+	UPLOAD_BATCH_RECORDING,
+	UPLOAD_BATCH_SUBMITTED,
+
+} UploadBatchState;
+
+typedef struct UploadBatch
+{
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+
+	/*
+		Asynchronous mode only: consumer queue side of the batch,
+		waiting for the transfer queue side with the semaphore.
+	*/
+	VkCommandBuffer acquire_command_buffer;
+	VkSemaphore transfer_finished;
+
+	VkBufferMemoryBarrier *ownership_barriers;
+	uint32_t ownership_barrier_count;
+	uint32_t ownership_barrier_capacity;
+
+	/*
+		Ring position right after the last staging byte of the batch.
+		Everything before it is free once the fence signals.
+	*/
+	VkDeviceSize ring_end;
+
+	UploadBatchState state;
+
+} UploadBatch;
+
+/* Module state */
+
+static VkDevice _device;
+static VkQueue _transfer_queue;
+static VkQueue _consumer_queue;
+static uint32_t _transfer_family_idx;
+static uint32_t _consumer_family_idx;
+static bool _async;
+
+static VkCommandPool _command_pool;
+static VkCommandPool _acquire_command_pool;
+
+static VkBuffer _staging_buffer;
+static DeviceMemoryAllocation _staging_buffer_memory;
+static VkDeviceSize _staging_size;
+
+/*
+	Monotonic ring positions, staging offset is position % _staging_size.
+	[_ring_tail, _ring_head) is used by recorded or submitted batches.
+*/
+static VkDeviceSize _ring_head;
+static VkDeviceSize _ring_tail;
+
+static UploadBatch _batches[UPLOAD_BATCHES_COUNT];
+static uint32_t _current_batch_idx;
+static uint32_t _oldest_batch_idx;
+static uint32_t _submitted_batches_count;
+
+/* Helper functions */
+
+static bool _retire_oldest_batch(bool wait)
+{
+	UploadBatch *batch = _batches + _oldest_batch_idx;
+
+	if (wait)
+	{
+		if (vkWaitForFences(_device, 1, &(batch->fence), VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+		{
+			return false;
+		}
+	}
+	else if (vkGetFenceStatus(_device, batch->fence) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	_ring_tail = batch->ring_end;
+
+	batch->state = UPLOAD_BATCH_IDLE;
+
+	_oldest_batch_idx = (_oldest_batch_idx + 1) % UPLOAD_BATCHES_COUNT;
+	_submitted_batches_count -= 1;
+
+	return true;
+}
+static void _retire_finished_batches()
+{
+	while (_submitted_batches_count > 0 && _retire_oldest_batch(false));
+}
+static bool _begin_batch()
+{
+	UploadBatch *batch = _batches + _current_batch_idx;
+
+	if (batch->state == UPLOAD_BATCH_RECORDING)
+	{
+		return true;
+	}
+
+	/*
+		All batches are in flight, current one is the oldest.
+	*/
+	if (batch->state == UPLOAD_BATCH_SUBMITTED && !_retire_oldest_batch(true))
+	{
+		return false;
+	}
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	if (
+		vkResetFences(_device, 1, &(batch->fence)) != VK_SUCCESS ||
+		vkBeginCommandBuffer(batch->command_buffer, &begin_info) != VK_SUCCESS
+	) {
+		return false;
+	}
+
+	batch->ring_end = _ring_head;
+	batch->ownership_barrier_count = 0;
+	batch->state = UPLOAD_BATCH_RECORDING;
+
+	return true;
+}
+static bool _add_ownership_barrier(UploadBatch *batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (batch->ownership_barrier_count == batch->ownership_barrier_capacity)
+	{
+		uint32_t capacity = batch->ownership_barrier_capacity > 0 ? batch->ownership_barrier_capacity * 2 : 16;
+
+		VkBufferMemoryBarrier *barriers = realloc(batch->ownership_barriers, sizeof(VkBufferMemoryBarrier) * capacity);
+
+		if (barriers == NULL)
+		{
+			return false;
+		}
+
+		batch->ownership_barriers = barriers;
+		batch->ownership_barrier_capacity = capacity;
+	}
+
+	VkBufferMemoryBarrier release_barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = 0,
+		.srcQueueFamilyIndex = _transfer_family_idx,
+		.dstQueueFamilyIndex = _consumer_family_idx,
+		.buffer = buffer,
+		.offset = offset,
+		.size = size,
+	};
+
+	batch->ownership_barriers[batch->ownership_barrier_count] = release_barrier;
+	batch->ownership_barrier_count += 1;
+
+	return true;
+}
+/*
+	Release uploaded ranges on the transfer queue, acquire them on the
+	consumer queue once the copies are done.
+*/
+static bool _submit_async_batch(UploadBatch *batch)
+{
+	vkCmdPipelineBarrier(
+		batch->command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, NULL,
+		batch->ownership_barrier_count, batch->ownership_barriers,
+		0, NULL
+	);
+
+	if (vkEndCommandBuffer(batch->command_buffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkSubmitInfo transfer_submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &(batch->command_buffer),
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &(batch->transfer_finished),
+	};
+
+	if (vkQueueSubmit(_transfer_queue, 1, &transfer_submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	/*
+		Acquire barriers repeat the release ones, only access masks differ.
+	*/
+	for (uint32_t i = 0; i < batch->ownership_barrier_count; i += 1)
+	{
+		batch->ownership_barriers[i].srcAccessMask = 0;
+		batch->ownership_barriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	}
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	if (vkBeginCommandBuffer(batch->acquire_command_buffer, &begin_info) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	vkCmdPipelineBarrier(
+		batch->acquire_command_buffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0,
+		0, NULL,
+		batch->ownership_barrier_count, batch->ownership_barriers,
+		0, NULL
+	);
+
+	if (vkEndCommandBuffer(batch->acquire_command_buffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo acquire_submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &(batch->transfer_finished),
+		.pWaitDstStageMask = &wait_stage,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &(batch->acquire_command_buffer),
+	};
+
+	return vkQueueSubmit(_consumer_queue, 1, &acquire_submit_info, batch->fence) == VK_SUCCESS;
+}
+static bool _reserve_staging(VkDeviceSize size, VkDeviceSize *offset)
+{
+	while (true)
+	{
+		if (_submitted_batches_count == 0 && _batches[_current_batch_idx].state != UPLOAD_BATCH_RECORDING)
+		{
+			_ring_head = 0;
+			_ring_tail = 0;
+		}
+
+		VkDeviceSize start = (_ring_head + UPLOAD_ALIGNMENT - 1) & ~((VkDeviceSize)UPLOAD_ALIGNMENT - 1);
+
+		/*
+			Copy source must be contiguous, skip the ring remainder.
+		*/
+		if (start % _staging_size + size > _staging_size)
+		{
+			start = (start / _staging_size + 1) * _staging_size;
+		}
+
+		if (start + size - _ring_tail <= _staging_size)
+		{
+			_ring_head = start + size;
+			*offset = start % _staging_size;
+
+			return true;
+		}
+
+		if (_batches[_current_batch_idx].state == UPLOAD_BATCH_RECORDING && !submit_uploads())
+		{
+			return false;
+		}
+
+		if (_submitted_batches_count == 0 || !_retire_oldest_batch(true))
+		{
+			return false;
+		}
+	}
+}
+
+/* Module interface */
+
+bool setup_upload_manager(
+	VkDevice device,
+	VkQueue transfer_queue,
+	uint32_t transfer_family_idx,
+	VkQueue consumer_queue,
+	uint32_t consumer_family_idx,
+	VkDeviceSize staging_size
+) {
+	_device = device;
+	_transfer_queue = transfer_queue;
+	_transfer_family_idx = transfer_family_idx;
+	_consumer_queue = consumer_queue;
+	_consumer_family_idx = consumer_family_idx;
+	_async = transfer_family_idx != consumer_family_idx;
+	_staging_size = staging_size;
+
+	_ring_head = 0;
+	_ring_tail = 0;
+	_current_batch_idx = 0;
+	_oldest_batch_idx = 0;
+	_submitted_batches_count = 0;
+
+	VkBufferCreateInfo buffer_ci = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = staging_size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+
+	if (vkCreateBuffer(_device, &buffer_ci, NULL, &_staging_buffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(_device, _staging_buffer, &memory_requirements);
+
+	if (
+		!allocate_device_memory(
+			&memory_requirements,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			true,
+			&_staging_buffer_memory
+		) ||
+		vkBindBufferMemory(_device, _staging_buffer, _staging_buffer_memory.memory, _staging_buffer_memory.offset) != VK_SUCCESS
+	) {
+		return false;
+	}
+
+	VkCommandPoolCreateInfo command_pool_ci = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = _transfer_family_idx,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	};
+
+	if (vkCreateCommandPool(_device, &command_pool_ci, NULL, &_command_pool) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkCommandBuffer command_buffers[UPLOAD_BATCHES_COUNT];
+	VkCommandBuffer acquire_command_buffers[UPLOAD_BATCHES_COUNT];
+
+	VkCommandBufferAllocateInfo command_buffers_ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = _command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = UPLOAD_BATCHES_COUNT,
+	};
+
+	if (vkAllocateCommandBuffers(_device, &command_buffers_ai, command_buffers) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	if (_async)
+	{
+		command_pool_ci.queueFamilyIndex = _consumer_family_idx;
+
+		if (vkCreateCommandPool(_device, &command_pool_ci, NULL, &_acquire_command_pool) != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		command_buffers_ai.commandPool = _acquire_command_pool;
+
+		if (vkAllocateCommandBuffers(_device, &command_buffers_ai, acquire_command_buffers) != VK_SUCCESS)
+		{
+			return false;
+		}
+	}
+
+	VkFenceCreateInfo fence_ci = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+
+	VkSemaphoreCreateInfo semaphore_ci = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+
+	for (uint32_t i = 0; i < UPLOAD_BATCHES_COUNT; i += 1)
+	{
+		UploadBatch *batch = _batches + i;
+
+		memset(batch, 0, sizeof(UploadBatch));
+
+		batch->command_buffer = command_buffers[i];
+		batch->state = UPLOAD_BATCH_IDLE;
+
+		if (vkCreateFence(_device, &fence_ci, NULL, &(batch->fence)) != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		if (_async)
+		{
+			batch->acquire_command_buffer = acquire_command_buffers[i];
+
+			if (vkCreateSemaphore(_device, &semaphore_ci, NULL, &(batch->transfer_finished)) != VK_SUCCESS)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+void clear_upload_manager()
+{
+	wait_uploads();
+
+	for (uint32_t i = 0; i < UPLOAD_BATCHES_COUNT; i += 1)
+	{
+		vkDestroyFence(_device, _batches[i].fence, NULL);
+		vkDestroySemaphore(_device, _batches[i].transfer_finished, NULL);
+
+		free(_batches[i].ownership_barriers);
+	}
+
+	vkDestroyCommandPool(_device, _command_pool, NULL);
+
+	if (_async)
+	{
+		vkDestroyCommandPool(_device, _acquire_command_pool, NULL);
+	}
+
+	vkDestroyBuffer(_device, _staging_buffer, NULL);
+	free_device_memory(&_staging_buffer_memory);
+}
+bool enqueue_buffer_upload(
+	VkBuffer dst_buffer,
+	VkDeviceSize dst_offset,
+	const void *data,
+	VkDeviceSize size
+) {
+	const char *src = (const char *)data;
+
+	/*
+		Half of the ring at most, so that a chunk always fits
+		once older batches are retired.
+	*/
+	VkDeviceSize max_chunk_size = _staging_size / 2;
+
+	_retire_finished_batches();
+
+	while (size > 0)
+	{
+		VkDeviceSize chunk_size = size < max_chunk_size ? size : max_chunk_size;
+		VkDeviceSize staging_offset;
+
+		if (!_reserve_staging(chunk_size, &staging_offset) || !_begin_batch())
+		{
+			return false;
+		}
+
+		UploadBatch *batch = _batches + _current_batch_idx;
+
+		memcpy((char *)_staging_buffer_memory.mapped + staging_offset, src, (size_t)chunk_size);
+
+		VkBufferCopy copy_region = {
+			.srcOffset = staging_offset,
+			.dstOffset = dst_offset,
+			.size = chunk_size,
+		};
+
+		vkCmdCopyBuffer(batch->command_buffer, _staging_buffer, dst_buffer, 1, &copy_region);
+
+		if (_async && !_add_ownership_barrier(batch, dst_buffer, dst_offset, chunk_size))
+		{
+			return false;
+		}
+
+		batch->ring_end = _ring_head;
+
+		src += chunk_size;
+		dst_offset += chunk_size;
+		size -= chunk_size;
+	}
+
+	return true;
+}
+bool submit_uploads()
+{
+	UploadBatch *batch = _batches + _current_batch_idx;
+
+	if (batch->state != UPLOAD_BATCH_RECORDING)
+	{
+		return true;
+	}
+
+	if (_async)
+	{
+		if (!_submit_async_batch(batch))
+		{
+			return false;
+		}
+
+		batch->state = UPLOAD_BATCH_SUBMITTED;
+
+		_submitted_batches_count += 1;
+		_current_batch_idx = (_current_batch_idx + 1) % UPLOAD_BATCHES_COUNT;
+
+		return true;
+	}
+
+	/*
+		Make copies visible to whatever reads the buffers next.
+	*/
+	VkMemoryBarrier memory_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+	};
+
+	vkCmdPipelineBarrier(
+		batch->command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0,
+		1, &memory_barrier,
+		0, NULL,
+		0, NULL
+	);
+
+	if (vkEndCommandBuffer(batch->command_buffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &(batch->command_buffer),
+	};
+
+	if (vkQueueSubmit(_consumer_queue, 1, &submit_info, batch->fence) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	batch->state = UPLOAD_BATCH_SUBMITTED;
+
+	_submitted_batches_count += 1;
+	_current_batch_idx = (_current_batch_idx + 1) % UPLOAD_BATCHES_COUNT;
+
+	return true;
+}
+bool wait_uploads()
+{
+	if (!submit_uploads())
+	{
+		return false;
+	}
+
+	while (_submitted_batches_count > 0)
+	{
+		if (!_retire_oldest_batch(true))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
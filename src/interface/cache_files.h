@@ -0,0 +1,28 @@
+#ifndef ZGAME_CACHE_FILES
+#define ZGAME_CACHE_FILES
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Files the engine keeps between runs to start faster.
+
+	They live in $XDG_CACHE_HOME/zGame, or ~/.cache/zGame when the
+	variable is unset, never relative to the working directory.
+*/
+
+#define CACHE_FILE_PATH_SIZE 4096
+
+/*
+	Creates the cache directory if needed.
+	False without a usable directory, callers then run uncached.
+*/
+bool get_cache_file_path(const char *file_name, char *path, size_t path_size);
+
+/*
+	Written to a temporary file which is synced before it is renamed over
+	path, so neither a crash nor a power loss leaves a truncated file.
+*/
+bool write_file_atomically(const char *path, const void *data, size_t size);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef ZGAME_COMPUTE_TUNING
+#define ZGAME_COMPUTE_TUNING
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+	On-disk cache of tuned compute workgroup sizes.
+
+	Records are keyed by device UUID and driver version, so that a
+	driver update triggers tuning again. The file lives in the cache
+	directory of cache_files.h.
+*/
+
+#define COMPUTE_TUNING_CACHE_FILE_NAME "compute_tuning.cache"
+
+bool load_tuned_workgroup_size(
+	const uint8_t device_uuid[VK_UUID_SIZE],
+	uint32_t driver_version,
+
+	uint32_t *workgroup_size
+);
+bool store_tuned_workgroup_size(
+	const uint8_t device_uuid[VK_UUID_SIZE],
+	uint32_t driver_version,
+	uint32_t workgroup_size
+);
+
+#endif
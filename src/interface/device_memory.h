@@ -0,0 +1,79 @@
+#ifndef ZGAME_DEVICE_MEMORY
+#define ZGAME_DEVICE_MEMORY
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+	Device memory sub-allocator.
+
+	Memory is requested from the driver in large blocks per memory type
+	and split with a buddy allocator. Resources which would take more
+	than half of a block get a dedicated VkDeviceMemory. Blocks of
+	host visible memory types are mapped once for their whole lifetime.
+*/
+
+#define DEDICATED_ALLOCATION_BLOCK_IDX UINT32_MAX
+
+typedef struct DeviceMemoryAllocation
+{
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+
+	/*
+		Host address of the allocation start, NULL for memory
+		which is not host visible.
+	*/
+	void *mapped;
+
+	uint32_t pool_idx;
+	uint32_t block_idx;
+	uint32_t order;
+
+} DeviceMemoryAllocation;
+
+typedef struct DeviceMemoryStats
+{
+	uint32_t block_count;
+	uint32_t dedicated_allocation_count;
+	uint32_t allocation_count;
+
+	/*
+		Bytes taken from the driver, bytes handed out to resources
+		(rounded up to buddy node sizes) and bytes actually requested.
+	*/
+	VkDeviceSize reserved_bytes;
+	VkDeviceSize used_bytes;
+	VkDeviceSize requested_bytes;
+
+	/*
+		fragmentation = 1 - sum of per block largest free ranges / free bytes in blocks.
+		0 means free memory of every block is available as a single range.
+	*/
+	VkDeviceSize largest_free_range;
+	float fragmentation;
+
+} DeviceMemoryStats;
+
+bool setup_device_memory(VkPhysicalDevice physical_device, VkDevice device);
+void clear_device_memory();
+
+/*
+	linear_resource is true for buffers and linear images. Linear and
+	optimal resources never share a block, so bufferImageGranularity
+	is respected without padding.
+*/
+bool allocate_device_memory(
+	const VkMemoryRequirements *requirements,
+	VkMemoryPropertyFlags properties,
+	bool linear_resource,
+
+	DeviceMemoryAllocation *allocation
+);
+void free_device_memory(DeviceMemoryAllocation *allocation);
+
+void get_device_memory_stats(DeviceMemoryStats *stats);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ZGAME_EMBEDDED_SHADERS
+#define ZGAME_EMBEDDED_SHADERS
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	SPIR-V of every shader, linked into the executable.
+
+	build/linux/Makefile generates the table from the compiled .spv files,
+	shaders are named after them. Words keep the byte order of the build host.
+*/
+
+typedef struct EmbeddedShader
+{
+	const char *name;
+	const uint32_t *code;
+	size_t code_size;
+
+} EmbeddedShader;
+
+extern const EmbeddedShader embedded_shaders[];
+extern const uint32_t embedded_shaders_count;
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef ZGAME_GPU_PROFILER
+#define ZGAME_GPU_PROFILER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+	Timestamp profiling of the commands recorded every frame.
+
+	Every frame in flight owns a timestamp query pool. A command buffer
+	starts a timeline with begin_gpu_timeline, then every mark_gpu_pass
+	written after a dispatch, barrier or render pass closes a pass lasting
+	since the previous timestamp of the timeline. Passes of the same name
+	in a frame add up, a timeline counts as a pass spanning all its marks.
+
+	Results of a frame are read once its fence has been waited for,
+	frames_in_flight frames after recording, so reading never waits on GPU.
+	Queue families without timestamp support make every call do nothing.
+
+	Names are compared by content and must outlive the profiler,
+	string literals are expected.
+*/
+
+#define GPU_PROFILER_MAX_TIMESTAMPS 512  /* per frame */
+#define GPU_PROFILER_MAX_PASSES 64  /* distinct names */
+
+typedef struct GpuPassStats
+{
+	const char *name;
+
+	/*
+		Last collected frame, negative if the pass did not run in it.
+	*/
+	double last_milliseconds;
+	double average_milliseconds;
+	double max_milliseconds;
+
+	/*
+		Collected frames which ran the pass since the last reset.
+	*/
+	uint32_t frame_count;
+
+} GpuPassStats;
+
+typedef struct GpuProfilerStats
+{
+	GpuPassStats passes[GPU_PROFILER_MAX_PASSES];
+	uint32_t pass_count;
+
+	uint32_t frame_count;
+
+	/*
+		Marks past GPU_PROFILER_MAX_TIMESTAMPS in a frame are not written,
+		their time goes to the next written mark of the timeline.
+	*/
+	uint32_t dropped_mark_count;
+
+} GpuProfilerStats;
+
+/*
+	Stats are printed and reset every log_interval collected frames, 0 never logs.
+*/
+bool setup_gpu_profiler(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family_idx, uint32_t frames_count, uint32_t log_interval);
+void clear_gpu_profiler();
+
+bool is_gpu_profiler_supported();
+
+/*
+	Resets the queries of frame_idx. Recorded into the command buffer
+	submitted first in the frame, before any timeline of the frame.
+*/
+void begin_gpu_profiler_frame(VkCommandBuffer command_buffer, uint32_t frame_idx);
+
+void begin_gpu_timeline(VkCommandBuffer command_buffer, const char *name);
+void mark_gpu_pass(VkCommandBuffer command_buffer, const char *name);
+
+/*
+	Called once the fence of frame_idx has been waited for.
+	False if the frame recorded nothing since it was collected last.
+*/
+bool collect_gpu_profiler_frame(uint32_t frame_idx);
+
+/*
+	Time of the pass in the last collected frame, negative if unknown.
+*/
+double get_gpu_pass_milliseconds(const char *name);
+
+const GpuProfilerStats *get_gpu_profiler_stats();
+void reset_gpu_profiler_stats();
+
+#endif
@@ -17,6 +17,12 @@ typedef struct Quaternion
 	float w;
 
 } Quaternion;
+typedef struct Vector2
+{
+	float x;
+	float y;
+
+} Vector2;
 typedef struct Vector3
 {
 	float x;
@@ -0,0 +1,36 @@
+#ifndef ZGAME_PIPELINE_CACHE
+#define ZGAME_PIPELINE_CACHE
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+	On-disk VkPipelineCache shared by every pipeline creation.
+
+	The blob is loaded at setup when its header matches the vendor,
+	device and pipeline cache UUID of the physical device, a driver
+	update or another GPU starts from an empty cache. The file lives
+	in the cache directory of cache_files.h.
+*/
+
+#define PIPELINE_CACHE_FILE_NAME "pipeline.cache"
+
+bool setup_pipeline_cache(VkPhysicalDevice physical_device, VkDevice device);
+
+/*
+	Destroys the cache without writing it, store_pipeline_cache first to keep it.
+*/
+void clear_pipeline_cache();
+
+VkPipelineCache get_pipeline_cache();
+
+/*
+	True if setup found a valid blob, pipelines created
+	afterwards should mostly skip compilation.
+*/
+bool is_pipeline_cache_warm();
+
+bool store_pipeline_cache();
+
+#endif
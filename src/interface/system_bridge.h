@@ -7,6 +7,7 @@
 #include <GLFW/glfw3.h>
 
 #include "math3d.h"
+#include "device_memory.h"
 
 #define VK_FLAGS_NONE 0
 
@@ -51,6 +52,18 @@ typedef struct OperationQueueFamilies
 	int compute_family_idx;
 	int present_family_idx;
 
+	/*
+		Transfer only family if the device has one,
+		compute family otherwise.
+	*/
+	int transfer_family_idx;
+
+	/*
+		Software implementations expose a single queue,
+		compute, graphics and present then share it.
+	*/
+	uint32_t graphics_queue_count;
+
 	bool use_same_family;
 
 } OperationQueueFamilies;
@@ -90,6 +103,29 @@ typedef struct SwapChainFramebuffers
 
 } SwapChainFramebuffers;
 
+/*
+	Swap chain replaced on resize together with the resources sized by it.
+	Frames in flight may still render into them, they are destroyed once
+	the fence of every frame in flight has been waited for.
+*/
+typedef struct RetiredSwapChain
+{
+	VkSwapchainKHR swap_chain;
+	SwapChainImages images;
+	SwapChainImageViews image_views;
+	SwapChainFramebuffers framebuffers;
+
+	VkImage depth_image;
+	VkImageView depth_image_view;
+	DeviceMemoryAllocation depth_image_memory;
+
+	/*
+		Bit per frame in flight not waited for since retirement.
+	*/
+	uint32_t pending_frames_mask;
+
+} RetiredSwapChain;
+
 typedef struct CommandBuffers
 {
 	VkCommandBuffer *data;
@@ -113,6 +149,17 @@ typedef struct Vertex
 
 } Vertex;
 
+/*
+	Vertex of PARTICLE_FORMAT_HALF and PARTICLE_FORMAT_UNORM16 expansion:
+	half float clip space position and RGBA8 unorm color, 12 bytes instead of 32.
+*/
+typedef struct CompactVertex
+{
+	uint16_t position[4];
+	uint32_t color;
+
+} CompactVertex;
+
 typedef struct Vertices
 {
 	Vertex *data;
@@ -135,30 +182,515 @@ typedef struct Particle
 
 } Particle;
 
+/*
+	Visible particle of the compact formats: xyz and w = 1 as half floats
+	or 16 bit unorms inside the particle bounds, RGBA8 unorm color.
+*/
+typedef struct CompactParticle
+{
+	uint16_t position[4];
+	uint32_t color;
+
+} CompactParticle;
+
+/*
+	Particles stored as one stream per attribute, passes touching
+	positions only never pull colors through the cache.
+	Particle arrays are converted with import_particles and export_particles.
+*/
 typedef struct Particles
 {
-	Particle *data;
+	Vector4 *positions;
+	Color *colors;
 	uint32_t count;
 
 } Particles;
 
-typedef struct UniformData
+/*
+	Simulated state of a particle, the physics pass integrates it on GPU.
+	velocity.w is the remaining life time in seconds, INFINITY never dies.
+	GPU keeps positions, velocities and colors in separate streams,
+	interleaved states are only uploaded for spawned particles.
+*/
+typedef struct ParticleState
 {
-	Matrix4x4 model;
-	Matrix4x4 view;
-	Matrix4x4 projection;
+	Vector4 position;
+	Vector4 velocity;
+	Color color;
+
+} ParticleState;
+
+typedef struct ParticleStates
+{
+	ParticleState *data;
+	uint32_t count;
+	uint32_t capacity;
+
+} ParticleStates;
+
+/*
+	Times of one frame in milliseconds. GPU times span the compute and graphics
+	timelines of the GPU profiler, they stay negative when they are not known.
+*/
+typedef struct FrameTimings
+{
+	double cpu_milliseconds;
+	double gpu_compute_milliseconds;
+	double gpu_graphics_milliseconds;
+
+} FrameTimings;
+
+typedef struct FrameResources
+{
+	VkSemaphore image_available;
+	VkSemaphore compute_finished;
+	VkSemaphore render_finished;
+	VkFence in_flight;
+
+	/*
+		GPU times of the frame submitted last with this resources go here
+		once its fence is signaled, NULL when nobody asked for them.
+	*/
+	FrameTimings *timings;
+
+	/*
+		Outputs of the compute pass, the graphics pass of the same frame reads them.
+	*/
+	VkBuffer vertex_buffer;
+	DeviceMemoryAllocation vertex_buffer_memory;
+	VkBuffer index_buffer;
+	DeviceMemoryAllocation index_buffer_memory;
+
+	/*
+		Visible particles written by the cull pass, the graphics pass of the same frame reads them.
+		Arguments hold their count and the indirect commands drawing them.
+	*/
+	VkBuffer particle_buffer;
+	DeviceMemoryAllocation particle_buffer_memory;
+	VkBuffer arguments_buffer;
+	DeviceMemoryAllocation arguments_buffer_memory;
+
+	/*
+		Particles spawned on host, uploaded before the compute pass of the frame.
+	*/
+	VkBuffer spawn_buffer;
+	DeviceMemoryAllocation spawn_buffer_memory;
+
+	VkDescriptorSet descriptor_set;
+
+	/*
+		Physics reading particle state i and writing state 1 - i.
+	*/
+	VkDescriptorSet physics_descriptor_sets[2];
+
+} FrameResources;
+
+typedef struct Frames
+{
+	FrameResources *data;
+	uint32_t count;
+
+} Frames;
+
+typedef enum RenderPath
+{
+	/*
+		Compute pass expands every particle into 4 vertices and 6 indices
+		of per-frame buffers, the graphics pass draws them indexed.
+	*/
+	RENDER_PATH_COMPUTE_EXPANDED,
+
+	/*
+		Vertex shader builds quad corners from gl_VertexIndex reading
+		the particle buffer directly, no expansion pass and buffers.
+	*/
+	RENDER_PATH_VERTEX_PULLING,
+
+	/*
+		One shared quad drawn instanceCount = particle count times,
+		particles are fetched as per-instance vertex attributes.
+	*/
+	RENDER_PATH_INSTANCED,
+
+} RenderPath;
+
+/*
+	Storage of the visible particles and expanded vertices the graphics pass reads.
+	Simulated state stays 32 bit float whatever the format.
+*/
+typedef enum ParticleFormat
+{
+	/*
+		Particle and Vertex, 32 bytes each.
+	*/
+	PARTICLE_FORMAT_FLOAT,
+
+	/*
+		CompactParticle with half float positions and CompactVertex,
+		12 bytes each. Precision drops with the distance from the origin.
+	*/
+	PARTICLE_FORMAT_HALF,
+
+	/*
+		CompactParticle with 16 bit unorm positions inside the particle bounds
+		and CompactVertex, 12 bytes each. Precision is even over the bounds,
+		particles outside of them are culled.
+	*/
+	PARTICLE_FORMAT_UNORM16,
+
+} ParticleFormat;
+
+/*
+	Smoothed particle hydrodynamics between alive particles.
+	Neighbors are found through a uniform grid hashed into a table,
+	cells are smoothing_radius wide.
+*/
+typedef struct FluidSettings
+{
+	bool enabled;
+
+	float smoothing_radius;
+	float particle_mass;
+	float rest_density;
+	float stiffness;
+	float viscosity;
+
+} FluidSettings;
+
+typedef enum GravitySolver
+{
+	/*
+		Particles only feel the uniform gravity of the settings.
+	*/
+	GRAVITY_SOLVER_NONE,
+
+	/*
+		Every alive particle pulls every other one, summed exactly
+		in tiles of positions shared by a workgroup. O(N^2) per step.
+	*/
+	GRAVITY_SOLVER_DIRECT,
+
+	/*
+		Barnes-Hut: particles are sorted along a Morton curve into a binary
+		radix tree, nodes far enough for the opening angle pull as one body
+		at their center of mass. O(N log N) per step.
+	*/
+	GRAVITY_SOLVER_TREE,
+
+} GravitySolver;
+
+/*
+	Mutual gravity between alive particles of equal mass.
+	Softening length keeps close encounters finite, it must not be 0.
+*/
+typedef struct NBodySettings
+{
+	GravitySolver solver;
+
+	float gravitational_constant;
+	float particle_mass;
+	float softening;
+
+	/*
+		Node size over distance below which the tree solver takes a node
+		as one body, 0 opens every node. Smaller is more accurate and slower.
+	*/
+	float opening_angle;
+
+} NBodySettings;
+
+typedef struct PhysicsSettings
+{
+	Vector3 gravity;
+	float drag;
+
+	/*
+		Fixed simulation step in seconds. Frames run as many steps as
+		the elapsed time covers, at most max_steps_per_frame, the rest
+		of the time is dropped so the simulation slows down instead of
+		falling further behind.
+	*/
+	float time_step;
+	uint32_t max_steps_per_frame;
+
+	/*
+		Initial number of particles alive at once, including the ones
+		of create_particles. Storage grows when spawned particles need it.
+	*/
+	uint32_t particle_capacity;
+
+	/*
+		New particles per second, they start at the emitter position
+		flying in random directions and die after particle_life_time.
+		Particles of create_particles never die.
+	*/
+	float emission_rate;
+	float emission_speed;
+	float particle_life_time;
+	Vector3 emitter_position;
+	Color emission_color;
+
+	FluidSettings fluid;
+	NBodySettings nbody;
+
+} PhysicsSettings;
+
+/*
+	Frames are rendered into an offscreen color image instead of a window,
+	no GLFW, surface or swap chain is created and any device type is accepted,
+	so render farm nodes and software implementations run the same passes.
+	Every frame advances the simulation by exactly one time step.
+*/
+typedef struct HeadlessSettings
+{
+	bool enabled;
+
+	uint32_t width;
+	uint32_t height;
+
+	/*
+		Number of frames render draws before it returns.
+	*/
+	uint32_t frame_count;
+
+} HeadlessSettings;
+
+typedef struct RenderSettings
+{
+	/*
+		Number of frames CPU may record ahead of GPU.
+		More frames give better throughput at the cost of input latency.
+		At most 32.
+	*/
+	uint32_t frames_in_flight;
+
+	RenderPath render_path;
+
+	/*
+		Preferred swap chain present mode, FIFO when the surface does not support it.
+	*/
+	VkPresentModeKHR present_mode;
+
+	/*
+		Visible particles are sorted back to front on GPU every frame
+		and drawn with alpha blending, depth is tested but not written.
+	*/
+	bool blend_particles;
+
+	ParticleFormat particle_format;
+
+	/*
+		Box the positions of PARTICLE_FORMAT_UNORM16 are relative to,
+		particles outside are not drawn in that format.
+	*/
+	Vector3 particle_bounds_min;
+	Vector3 particle_bounds_max;
+
+	/*
+		GPU time of every pass is printed every that many frames, 0 never prints.
+	*/
+	uint32_t gpu_profiler_log_interval;
+
+	PhysicsSettings physics;
+
+	HeadlessSettings headless;
+
+} RenderSettings;
+
+/*
+	Push constants of compute and graphics pipelines,
+	layout matches FrameConstants blocks of the shaders.
+*/
+typedef struct FrameConstants
+{
+	Matrix4x4 mvp;
 
-	uint32_t particle_count;
 	float particle_radius;
 
-} UniformData;
+	/*
+		Visible particle positions are stored as (position - origin) / scale,
+		0 and 1 unless the format is PARTICLE_FORMAT_UNORM16.
+	*/
+	float position_origin[3];
+	float position_scale[3];
+
+} FrameConstants;
+
+/*
+	Push constants of the frame passes after the physics steps,
+	radix sort passes take the digit they sort by after frame constants.
+*/
+typedef struct FramePassConstants
+{
+	FrameConstants frame;
+
+	uint32_t radix_shift;
 
-bool setup_window_and_gpu();
+} FramePassConstants;
+
+/*
+	Push constants of the physics pipelines,
+	layout matches PhysicsConstants blocks of the shaders.
+*/
+typedef struct PhysicsConstants
+{
+	Vector4 gravity;
+	Vector4 user_force;
+	Vector4 emitter_position;
+	Color emission_color;
+
+	float time_step;
+	float drag;
+	float emission_speed;
+	float particle_life_time;
+
+	uint32_t particle_capacity;
+	uint32_t emit_count;
+	uint32_t spawn_count;
+	uint32_t added_slots_count;
+	uint32_t seed;
+
+	/*
+		Gravitational constant times particle mass, read by N-body passes only.
+	*/
+	float gravity_strength;
+	float softening_squared;
+	float opening_angle_squared;
+
+	/*
+		Digit the Morton code sort passes of the tree solver sort by.
+	*/
+	uint32_t radix_shift;
+
+} PhysicsConstants;
+
+/*
+	Read by the fluid passes, layout matches FluidParameters blocks of the shaders.
+	Kernel scales are precomputed from the smoothing radius.
+*/
+typedef struct FluidParameters
+{
+	float smoothing_radius;
+	float particle_mass;
+	float rest_density;
+	float stiffness;
+	float viscosity;
+	float poly6_scale;
+	float spiky_scale;
+	uint32_t grid_table_size;
+
+} FluidParameters;
+
+/*
+	GPU counters of the particle lists, the step arguments pass
+	sizes the emit and physics dispatches of every step from them,
+	the cull arguments pass sizes the cull dispatch of the frame.
+*/
+typedef struct ParticleCounters
+{
+	VkDispatchIndirectCommand emit_dispatch;
+	VkDispatchIndirectCommand physics_dispatch;
+	VkDispatchIndirectCommand cull_dispatch;
+
+	/*
+		Spawned particles come first among the emitted ones.
+	*/
+	uint32_t emit_count;
+	uint32_t spawn_count;
+	uint32_t dead_count;
+
+} ParticleCounters;
+
+/*
+	Scratch physics state the compute workgroup size is tuned on,
+	every slot alive so that each invocation does a full particle update.
+*/
+typedef struct ComputeTuningWorkload
+{
+	VkBuffer position_buffers[2];
+	DeviceMemoryAllocation position_buffers_memory[2];
+	VkBuffer velocity_buffers[2];
+	DeviceMemoryAllocation velocity_buffers_memory[2];
+	VkBuffer alive_list_buffers[2];
+	DeviceMemoryAllocation alive_list_buffers_memory[2];
+	VkBuffer dead_list_buffer;
+	DeviceMemoryAllocation dead_list_buffer_memory;
+	VkBuffer counters_buffer;
+	DeviceMemoryAllocation counters_buffer_memory;
+
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+
+} ComputeTuningWorkload;
+
+/*
+	Written on GPU after the last physics step of a frame,
+	indirect commands of every render path read the particle count from here.
+	Only particles inside the view frustum are counted.
+*/
+typedef struct FrameArguments
+{
+	VkDispatchIndirectCommand expansion_dispatch;
+	VkDrawIndexedIndirectCommand indexed_draw;
+	VkDrawIndirectCommand pulling_draw;
+	VkDrawIndirectCommand instanced_draw;
+
+	uint32_t particle_count;
+
+} FrameArguments;
+
+/*
+	Written on GPU before the radix sort of a frame, every sort pass
+	splits keys into contiguous blocks of block_size, one per workgroup.
+*/
+typedef struct SortArguments
+{
+	VkDispatchIndirectCommand sort_dispatch;
+
+	uint32_t key_count;
+	uint32_t group_count;
+	uint32_t block_size;
+
+} SortArguments;
+
+bool setup_window_and_gpu(const RenderSettings *settings);
 void destroy_window_and_free_gpu();
 
 void create_particles();
 void destroy_particles();
 
+/*
+	Replaces the particles of create_particles before setup_window_and_gpu,
+	the streams are taken over and particles is left empty.
+*/
+void set_initial_particles(Particles *particles);
+
+/*
+	Conversion between interleaved particles and attribute streams.
+	import_particles allocates the streams, free_particles releases them.
+*/
+bool import_particles(Particles *particles, const Particle *data, uint32_t count);
+void export_particles(const Particles *particles, Particle *data);
+void free_particles(Particles *particles);
+
 void render();
 
+/*
+	Draws frame_count frames, headless or not, and fills timings with one entry
+	per frame unless it is NULL. GPU times of the last frames are read after
+	the device has gone idle, so all of them are known on return.
+*/
+bool render_frames(uint32_t frame_count, FrameTimings *timings);
+
+/*
+	Force applied to every particle on top of gravity and drag.
+*/
+void set_user_force(const Vector3 *force);
+
+/*
+	Particles spawned between two frames are uploaded in one batch
+	with the next frame, they start at rest and never die.
+*/
+bool spawn_particles(const Particle *particles, uint32_t count);
+
 #endif
@@ -0,0 +1,56 @@
+#ifndef ZGAME_UPLOAD_MANAGER
+#define ZGAME_UPLOAD_MANAGER
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+	Host to device buffer uploads through a staging ring.
+
+	Uploads are copied into a persistently mapped staging ring and
+	recorded into the current batch command buffer. A batch is
+	submitted once with a fence, its staging range is reused as soon
+	as that fence signals. When the ring is full the oldest batch is
+	waited for, uploads larger than the ring are split into chunks.
+
+	When the transfer queue belongs to another family than the queue
+	consuming the data, copies run asynchronously on the transfer queue.
+	Uploaded ranges are released to the consumer family and a semaphore
+	hands the batch over to an acquire submission on the consumer queue.
+	Everything submitted to the consumer queue afterwards sees the data,
+	other queues get it through their usual semaphores. Otherwise copies
+	are recorded and submitted on the consumer queue directly.
+
+	Callers must not upload into ranges the device may still be reading.
+*/
+
+bool setup_upload_manager(
+	VkDevice device,
+	VkQueue transfer_queue,
+	uint32_t transfer_family_idx,
+	VkQueue consumer_queue,
+	uint32_t consumer_family_idx,
+	VkDeviceSize staging_size
+);
+void clear_upload_manager();
+
+bool enqueue_buffer_upload(
+	VkBuffer dst_buffer,
+	VkDeviceSize dst_offset,
+	const void *data,
+	VkDeviceSize size
+);
+
+/*
+	Submit recorded uploads without waiting for them.
+*/
+bool submit_uploads();
+
+/*
+	Submit recorded uploads and wait until every submitted batch
+	has finished. All staging memory is free afterwards.
+*/
+bool wait_uploads();
+
+#endif
@@ -4,9 +4,53 @@
 #include "system_bridge.h"
 
 int main(int argc, char** argv) {
+	RenderSettings settings = {
+		.frames_in_flight = 2,
+		.render_path = RENDER_PATH_COMPUTE_EXPANDED,
+		.present_mode = VK_PRESENT_MODE_FIFO_KHR,
+		.blend_particles = false,
+		.particle_format = PARTICLE_FORMAT_FLOAT,
+		.particle_bounds_min = { -4.0f, -4.0f, -4.0f },
+		.particle_bounds_max = { 4.0f, 4.0f, 4.0f },
+		.gpu_profiler_log_interval = 0,
+		.physics = {
+			.gravity = { 0.0f, 0.1f, 0.0f },
+			.drag = 0.5f,
+			.time_step = 1.0f / 120.0f,
+			.max_steps_per_frame = 4,
+			.particle_capacity = 65536,
+			.emission_rate = 2000.0f,
+			.emission_speed = 0.5f,
+			.particle_life_time = 3.0f,
+			.emitter_position = { 0.0f, 0.0f, 0.0f },
+			.emission_color = { 1.0f, 0.5f, 0.0f, 1.0f },
+			.fluid = {
+				.enabled = false,
+				.smoothing_radius = 0.05f,
+				.particle_mass = 0.02f,
+				.rest_density = 1000.0f,
+				.stiffness = 3.0f,
+				.viscosity = 0.2f,
+			},
+			.nbody = {
+				.solver = GRAVITY_SOLVER_NONE,
+				.gravitational_constant = 1.0e-6f,
+				.particle_mass = 1.0f,
+				.softening = 0.01f,
+				.opening_angle = 0.5f,
+			},
+		},
+		.headless = {
+			.enabled = false,
+			.width = 800,
+			.height = 600,
+			.frame_count = 1000,
+		},
+	};
+
 	create_particles();
 
-	if (!setup_window_and_gpu())
+	if (!setup_window_and_gpu(&settings))
 	{
 		return EXIT_FAILURE;
 	}
@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform FrameConstants
+{
+	mat4 mvp;
+
+	float particle_radius;
+
+	float position_origin[3];
+	float position_scale[3];
+
+} frame;
+
+/*
+	Per vertex: corner of the shared quad.
+	Per instance: particle, compact formats are
+	converted to floats by the vertex input.
+*/
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 particle_position;
+layout(location = 2) in vec4 particle_color;
+
+layout(location = 0) out vec4 fragColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	vec3 origin = vec3(frame.position_origin[0], frame.position_origin[1], frame.position_origin[2]);
+	vec3 scale = vec3(frame.position_scale[0], frame.position_scale[1], frame.position_scale[2]);
+
+	vec4 position = frame.mvp * vec4(origin + particle_position.xyz * scale, 1.0);
+
+	position.xy += corner * frame.particle_radius;
+
+	fragColor = particle_color;
+	gl_Position = position;
+}
@@ -0,0 +1,116 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+/*
+	Storage of visible particles and vertices, matches ParticleFormat of system_bridge.h.
+*/
+layout(constant_id = 1) const uint particle_format = 0;
+
+const uint PARTICLE_FORMAT_FLOAT = 0;
+const uint PARTICLE_FORMAT_HALF = 1;
+const uint PARTICLE_FORMAT_UNORM16 = 2;
+
+struct Particle
+{
+	vec4 position;
+	vec4 color;
+};
+
+layout(push_constant) uniform FrameConstants
+{
+	mat4 mvp;
+
+	float particle_radius;
+
+	float position_origin[3];
+	float position_scale[3];
+
+} frame;
+
+layout(binding = 3) readonly buffer Particles
+{
+	uint particle_words[];
+};
+
+/*
+	Particle of 8 words or CompactParticle of 3 words written by the cull
+	or gather pass, positions are decoded from the particle bounds.
+*/
+Particle load_particle(uint particle_idx)
+{
+	vec3 origin = vec3(frame.position_origin[0], frame.position_origin[1], frame.position_origin[2]);
+	vec3 scale = vec3(frame.position_scale[0], frame.position_scale[1], frame.position_scale[2]);
+
+	vec3 stored;
+	vec4 color;
+
+	if (particle_format == PARTICLE_FORMAT_FLOAT)
+	{
+		uint word_idx = particle_idx * 8;
+
+		stored = uintBitsToFloat(uvec3(particle_words[word_idx + 0], particle_words[word_idx + 1], particle_words[word_idx + 2]));
+		color = uintBitsToFloat(uvec4(particle_words[word_idx + 4], particle_words[word_idx + 5], particle_words[word_idx + 6], particle_words[word_idx + 7]));
+	}
+	else
+	{
+		uint word_idx = particle_idx * 3;
+
+		if (particle_format == PARTICLE_FORMAT_HALF)
+		{
+			stored = vec3(unpackHalf2x16(particle_words[word_idx + 0]), unpackHalf2x16(particle_words[word_idx + 1]).x);
+		}
+		else
+		{
+			stored = vec3(unpackUnorm2x16(particle_words[word_idx + 0]), unpackUnorm2x16(particle_words[word_idx + 1]).x);
+		}
+
+		color = unpackUnorm4x8(particle_words[word_idx + 2]);
+	}
+
+	return Particle(vec4(origin + stored * scale, 1.0), color);
+}
+
+layout(location = 0) out vec4 fragColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+/*
+	Two triangles of a particle quad, corners and winding
+	match the quads expanded by shader.comp:
+
+	1       2
+	+-------+
+	|      /|
+	|    /  |
+	|  /    |
+	|/      |
+	+-------+
+	0       3
+
+	0 1 2, 0 2 3
+*/
+const vec2 corners[6] = vec2[](
+	vec2(-1.0,  1.0),
+	vec2(-1.0, -1.0),
+	vec2( 1.0, -1.0),
+	vec2(-1.0,  1.0),
+	vec2( 1.0, -1.0),
+	vec2( 1.0,  1.0)
+);
+
+void main()
+{
+	uint particle_idx = gl_VertexIndex / 6;
+
+	Particle particle = load_particle(particle_idx);
+
+	vec4 position = frame.mvp * particle.position;
+
+	position.xy += corners[gl_VertexIndex % 6] * frame.particle_radius;
+
+	fragColor = particle.color;
+	gl_Position = position;
+}